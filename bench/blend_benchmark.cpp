@@ -0,0 +1,92 @@
+#include "../include/algorithms.h"
+
+#include <atomic>
+#include <iostream>
+
+using namespace image_algorithms;
+
+namespace {
+    // counts image buffers, passes the work to the standard allocator
+    class CountingAllocator : public cv::MatAllocator {
+    private:
+        cv::MatAllocator* base = cv::Mat::getStdAllocator();
+
+    public:
+        mutable std::atomic<size_t> count{0};
+
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                               cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+            if (!data) {
+                ++count;
+            }
+            cv::UMatData* u = base->allocate(dims, sizes, type, data, step, flags, usage);
+            u->currAllocator = this;
+            return u;
+        }
+
+        bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+            return base->allocate(u, flags, usage);
+        }
+
+        void deallocate(cv::UMatData* u) const override {
+            base->deallocate(u);
+        }
+    };
+
+    CountingAllocator counter;
+
+    template<typename F>
+    void report(const char* name, F f, int runs) {
+        f();
+
+        size_t before = counter.count;
+        cv::TickMeter tm;
+        for (int i = 0; i < runs; ++i) {
+            tm.start();
+            f();
+            tm.stop();
+        }
+
+        std::cout << name << tm.getTimeMilli() / runs << " ms, "
+                  << (double) (counter.count - before) / runs << " allocation(s) per call" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 24 MP by default
+    int cols = argc > 1 ? std::stoi(argv[1]) : 6000;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 4000;
+    int runs = argc > 3 ? std::stoi(argv[3]) : 10;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    // blended image of another size
+    cv::Mat other(rows * 3 / 4, cols + 500, CV_8UC3);
+    cv::randu(other, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    cv::Mat::setDefaultAllocator(&counter);
+
+    std::cout << cols << "x" << rows << ", " << runs << " run(s)" << std::endl;
+
+    cv::Mat dst;
+
+    // what ApplyColor used to do: a plane of the color, then addWeighted
+    report("color, color plane:        ", [&]() {
+        cv::Mat plane(image.rows, image.cols, CV_8UC3, cv::Scalar(40, 80, 160));
+        cv::addWeighted(image, 0.8, plane, 0.2, 0, dst);
+    }, runs);
+    report("color, new result:         ", [&]() { dst = ApplyColor(160, 80, 40, 0.2).execute(image); }, runs);
+    report("color, reused result:      ", [&]() { apply_color(image, 160, 80, 40, 0.2, dst); }, runs);
+
+    // what the viewer used to do: crop both to the common part, then blend
+    report("blend, cropped copies:     ", [&]() {
+        cv::Rect common(0, 0, std::min(image.cols, other.cols), std::min(image.rows, other.rows));
+        cv::Mat a = image(common).clone(), b = other(common).clone();
+        cv::addWeighted(a, 0.5, b, 0.5, 0, dst);
+    }, runs);
+    report("blend, new result:         ", [&]() { dst = Blend(other, 0.5).execute(image); }, runs);
+    report("blend, reused result:      ", [&]() { blend(image, other, 0.5, dst); }, runs);
+
+    cv::Mat::setDefaultAllocator(nullptr);
+}
@@ -0,0 +1,53 @@
+#include "../include/algorithms.h"
+#include "../include/iirblur.h"
+
+#include <iostream>
+
+using namespace image_algorithms;
+
+namespace {
+    template<typename F>
+    double time_ms(F f, int runs) {
+        cv::TickMeter tm;
+        for (int i = 0; i < runs; ++i) {
+            tm.start();
+            f();
+            tm.stop();
+        }
+        return tm.getTimeMilli() / runs;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 12 MP by default, exact blurs with large sigma take long
+    int cols = argc > 1 ? std::stoi(argv[1]) : 4000;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 3000;
+    int runs = argc > 3 ? std::stoi(argv[3]) : 3;
+    double max_sigma = argc > 4 ? std::stod(argv[4]) : 200;
+
+    // smooth content, noise would be blurred to a flat gray by both
+    cv::Mat noise(rows / 16, cols / 16, CV_8UC3);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat image;
+    cv::resize(noise, image, cv::Size(cols, rows), 0, 0, cv::INTER_CUBIC);
+
+    std::cout << cols << "x" << rows << ", " << runs << " run(s)" << std::endl;
+    std::cout << "sigma   exact ms   recursive ms   speedup   max diff   PSNR dB" << std::endl;
+
+    for (double sigma : {2.0, 5.0, 10.0, 25.0, 50.0, 100.0, 200.0}) {
+        if (sigma > max_sigma) {
+            break;
+        }
+
+        Blur exact(sigma, Blur::Method::Exact);
+        Blur recursive(sigma, Blur::Method::Recursive);
+
+        cv::Mat expected, actual;
+        double exact_ms = time_ms([&]() { expected = exact.execute(image); }, runs);
+        double recursive_ms = time_ms([&]() { actual = recursive.execute(image); }, runs);
+
+        std::cout << sigma << "\t" << exact_ms << "\t" << recursive_ms << "\t"
+                  << exact_ms / recursive_ms << "x\t" << cv::norm(expected, actual, cv::NORM_INF) << "\t"
+                  << cv::PSNR(expected, actual) << std::endl;
+    }
+}
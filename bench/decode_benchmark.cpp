@@ -0,0 +1,67 @@
+#include "../include/algorithms.h"
+
+#include <cstdio>
+#include <iostream>
+
+using namespace image_algorithms;
+
+namespace {
+    template<typename F>
+    double time_ms(F f, int runs) {
+        f();
+
+        cv::TickMeter tm;
+        for (int i = 0; i < runs; ++i) {
+            tm.start();
+            f();
+            tm.stop();
+        }
+        return tm.getTimeMilli() / runs;
+    }
+
+    // smooth gradients with some grain, compresses like a photo
+    std::string write_test_jpeg(int cols, int rows) {
+        cv::Mat image(rows, cols, CV_8UC3);
+        for (int y = 0; y < rows; ++y) {
+            auto* row = image.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < cols; ++x) {
+                row[x] = cv::Vec3b(255 * x / cols, 255 * y / rows, 255 * (x + y) / (cols + rows));
+            }
+        }
+
+        cv::Mat grain(image.size(), CV_8UC3);
+        cv::randu(grain, cv::Scalar::all(0), cv::Scalar::all(16));
+        image += grain;
+
+        std::string path = cv::tempfile(".jpg");
+        cv::imwrite(path, image, {cv::IMWRITE_JPEG_QUALITY, 92});
+        return path;
+    }
+}
+
+// time to first pixel: how long the viewer waits before it can show something
+int main(int argc, char* argv[]) {
+    // 45 MP by default, a JPEG given as the first argument is used instead
+    std::string path = argc > 1 ? argv[1] : "";
+    int runs = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    const bool generated = path.empty();
+    if (generated) {
+        path = write_test_jpeg(8256, 5504);
+    }
+
+    cv::Mat full = read_image(path);
+    std::cout << path << ", " << full.cols << "x" << full.rows << ", " << runs << " run(s)" << std::endl;
+
+    std::cout << "full decode:     " << time_ms([&]() { full = read_image(path); }, runs) << " ms" << std::endl;
+    for (int factor : {2, 4, 8}) {
+        cv::Mat reduced;
+        double ms = time_ms([&]() { reduced = read_image_reduced(path, factor); }, runs);
+        std::cout << "1/" << factor << " decode:      " << ms << " ms, "
+                  << reduced.cols << "x" << reduced.rows << std::endl;
+    }
+
+    if (generated) {
+        std::remove(path.c_str());
+    }
+}
@@ -0,0 +1,73 @@
+#include "../include/displaybuffer.h"
+
+#include <QGuiApplication>
+#include <QPixmap>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+    // display part of every frame of a slider drag, mean and worst frame
+    template<typename F>
+    void report(const char* name, const std::vector<cv::Mat>& frames, F f) {
+        f(frames.front());
+
+        std::vector<double> times;
+        for (const cv::Mat& frame : frames) {
+            cv::TickMeter tm;
+            tm.start();
+            f(frame);
+            tm.stop();
+            times.push_back(tm.getTimeMilli());
+        }
+
+        double mean = 0;
+        for (double time : times) {
+            mean += time;
+        }
+        mean /= times.size();
+
+        std::cout << name << mean << " ms per frame, worst "
+                  << *std::max_element(times.begin(), times.end()) << " ms" << std::endl;
+    }
+}
+
+// QPixmap needs a platform, run with QT_QPA_PLATFORM=offscreen where there is no display
+int main(int argc, char* argv[]) {
+    QGuiApplication app(argc, argv);
+
+    // preview of a 1440p screen by default
+    int cols = argc > 1 ? std::stoi(argv[1]) : 2560;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 1440;
+    int count = argc > 3 ? std::stoi(argv[3]) : 60;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    // previews rendered for consecutive slider positions
+    std::vector<cv::Mat> frames(count);
+    for (int i = 0; i < count; ++i) {
+        image.convertTo(frames[i], CV_8U, 1, i);
+    }
+
+    std::cout << cols << "x" << rows << ", " << count << " frame(s)" << std::endl;
+
+    QPixmap pixmap;
+    report("wrap, rgbSwapped, fromImage: ", frames, [&](const cv::Mat& frame) {
+        QImage wrapped(frame.data, frame.cols, frame.rows, (int) frame.step, QImage::Format_RGB888);
+        pixmap = QPixmap::fromImage(wrapped.rgbSwapped());
+    });
+
+    DisplayBuffer buffer;
+    report("display buffer, all in view: ", frames, [&](const cv::Mat& frame) {
+        buffer.reset(frame);
+        buffer.prepare(cv::Rect(0, 0, frame.cols, frame.rows));
+    });
+
+    // zoomed in, a quarter of the preview is on screen
+    report("display buffer, 1/4 in view: ", frames, [&](const cv::Mat& frame) {
+        buffer.reset(frame);
+        buffer.prepare(cv::Rect(frame.cols / 4, frame.rows / 4, frame.cols / 2, frame.rows / 2));
+    });
+}
@@ -0,0 +1,142 @@
+#include "../include/history.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace image_algorithms;
+
+namespace {
+    // resident set size of this process in MB
+    double rss_mb() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmRSS:", 0) == 0) {
+                return std::stod(line.substr(6)) / 1024;
+            }
+        }
+        return 0;
+    }
+
+    using Edit = std::function<std::shared_ptr<const Command>(int step)>;
+
+    std::shared_ptr<const Command> global_edit(int step) {
+        switch (step % 6) {
+            case 0:
+                return std::make_shared<Brighten>(5);
+            case 1:
+                return std::make_shared<Saturate>(10);
+            case 2:
+                return std::make_shared<Hue>(3);
+            case 3:
+                return std::make_shared<Contrast>(5);
+            case 4:
+                return std::make_shared<Temperature>(-5);
+            default:
+                return std::make_shared<Blur>(1.5);
+        }
+    }
+
+    void run(const std::string& name, const controller::HistoryPolicy& policy, const cv::Mat& image, int steps,
+             const Edit& edit) {
+        double rss_before = rss_mb();
+
+        controller::History history(policy);
+        cv::Mat shown = history.execute(std::make_shared<Nothing>(), image);
+
+        cv::TickMeter edit_tm;
+        for (int i = 0; i < steps; ++i) {
+            edit_tm.start();
+            shown = history.execute(edit(i), shown);
+            edit_tm.stop();
+        }
+
+        double rss_after = rss_mb();
+        size_t versions = history.size();
+        size_t keyframes = history.keyframe_count();
+        size_t resident = history.resident_bytes();
+        size_t spilled = history.spilled_bytes();
+
+        double total_ms = 0, worst_ms = 0;
+        int undos = 0;
+        while (history.can_undo()) {
+            cv::TickMeter tm;
+            tm.start();
+            shown = history.undo();
+            tm.stop();
+
+            if (shown.empty()) {
+                std::cout << "  undo " << undos + 1 << " could not page in its keyframe" << std::endl;
+                break;
+            }
+
+            total_ms += tm.getTimeMilli();
+            worst_ms = std::max(worst_ms, tm.getTimeMilli());
+            ++undos;
+        }
+
+        std::cout << name << std::endl;
+        std::cout << "  versions kept:  " << versions << ", " << keyframes << " keyframe(s)" << std::endl;
+        std::cout << "  keyframes:      " << resident / (1 << 20) << " MB resident, "
+                  << spilled / (1 << 20) << " MB spilled" << std::endl;
+        std::cout << "  RSS growth:     " << rss_after - rss_before << " MB" << std::endl;
+        std::cout << "  edit:           " << edit_tm.getTimeMilli() / steps << " ms" << std::endl;
+        std::cout << "  undo mean/max:  " << (undos ? total_ms / undos : 0) << " / "
+                  << worst_ms << " ms over " << undos << " undo(s)" << std::endl;
+
+        if (policy.cache_budget > 0) {
+            ResultCache::Stats cache = history.cache_stats();
+            std::cout << "  result cache:   " << cache.hits << " hit(s), " << cache.misses << " miss(es), "
+                      << cache.evictions << " eviction(s), " << cache.bytes / (1 << 20) << " MB" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 24 MP by default
+    int cols = argc > 1 ? std::stoi(argv[1]) : 6000;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 4000;
+    int steps = argc > 3 ? std::stoi(argv[3]) : 30;
+    size_t budget_mb = argc > 4 ? std::stoul(argv[4]) : 1024;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    std::cout << cols << "x" << rows << ", " << steps << " edits, budget " << budget_mb << " MB" << std::endl;
+
+    // what the history used to do: an image per version
+    controller::HistoryPolicy every_version;
+    every_version.memory_budget = budget_mb << 20;
+    every_version.keyframe_interval = 1;
+    every_version.disk_budget = 0;
+    every_version.cache_budget = 0;
+    run("image per version", every_version, image, steps, global_edit);
+
+    controller::HistoryPolicy keyframes;
+    keyframes.memory_budget = budget_mb << 20;
+    keyframes.cache_budget = 0;
+    run("keyframes", keyframes, image, steps, global_edit);
+
+    // replays of undo are looked up
+    controller::HistoryPolicy cached = keyframes;
+    cached.cache_budget = controller::HistoryPolicy().cache_budget;
+    run("keyframes, result cache", cached, image, steps, global_edit);
+
+    // a quarter of the budget in memory, the rest paged out
+    controller::HistoryPolicy spilling = keyframes;
+    spilling.memory_budget = (budget_mb << 20) / 4;
+    spilling.disk_budget = budget_mb << 20;
+    run("keyframes, paged out", spilling, image, steps, global_edit);
+
+    // every crop keeps most of the tiles of the previous version
+    run("crops, image per version", every_version, image, steps, [cols, rows](int step) {
+        return std::make_shared<Crop>(cols - 16 * (step + 1), rows - 16 * (step + 1), 0, 0);
+    });
+
+    // same with the top left corner moving, tiles are shared off the origin too
+    run("offset crops, image per version", every_version, image, steps, [cols, rows](int step) {
+        return std::make_shared<Crop>(cols - 16 * (step + 1), rows - 16 * (step + 1), 16, 16);
+    });
+}
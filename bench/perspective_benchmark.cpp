@@ -0,0 +1,80 @@
+#include "../include/algorithms.h"
+#include "../include/preview.h"
+#include "../include/warp.h"
+
+#include <iostream>
+
+using namespace image_algorithms;
+
+namespace {
+    struct Timing {
+        double mean_ms = 0;
+        double max_ms = 0;
+    };
+
+    // quad of the image with its top left corner dragged by step * 8 pixels
+    std::shared_ptr<const Command> dragged(cv::Size size, int step) {
+        float w = (float) size.width, h = (float) size.height;
+        float d = 8.f * (float) (step + 1);
+        cv::Point2f quad[4] = {{d, d / 2}, {w, 0}, {w * 0.95f, h}, {w * 0.05f, h * 0.98f}};
+        return std::make_shared<TransformPerspective>(quad);
+    }
+
+    template<typename F>
+    Timing time_steps(int steps, F f) {
+        Timing res;
+        for (int i = 0; i < steps; ++i) {
+            cv::TickMeter tm;
+            tm.start();
+            f(i);
+            tm.stop();
+            res.mean_ms += tm.getTimeMilli() / steps;
+            res.max_ms = std::max(res.max_ms, tm.getTimeMilli());
+        }
+        return res;
+    }
+
+    void print(const char* name, const Timing& timing) {
+        std::cout << "  " << name << timing.mean_ms << " ms mean, " << timing.max_ms << " ms max" << std::endl;
+    }
+
+    void run(cv::Size size, int steps, cv::Size screen) {
+        cv::Mat image(size, CV_8UC3);
+        cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+        PreviewPyramid pyramid;
+        pyramid.reset(image);
+        Proxy proxy = pyramid.level(screen);
+
+        std::cout << size.width << "x" << size.height << " (" << size.area() / 1000000 << " MP), preview "
+                  << proxy.image.cols << "x" << proxy.image.rows << std::endl;
+
+        cv::Mat res;
+
+        // what every drag used to cost: one warpPerspective of the full image
+        print("full image, one call:      ", time_steps(steps, [&](int i) {
+            cv::Matx33d transform;
+            cv::Size output;
+            dragged(size, i)->warp(size, transform, output);
+            cv::warpPerspective(image, res, transform, output);
+        }));
+
+        // in bands on the thread pool, as the editor runs
+        print("full image, new corners:   ", time_steps(steps, [&](int i) {
+            res = dragged(size, i)->execute(image);
+        }));
+
+        print("proxy, new corners:        ", time_steps(steps, [&](int i) {
+            res = dragged(size, i)->scaled(proxy.scale)->execute(proxy.image);
+        }));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int steps = argc > 1 ? std::stoi(argv[1]) : 10;
+    cv::Size screen(argc > 2 ? std::stoi(argv[2]) : 1920, argc > 3 ? std::stoi(argv[3]) : 1080);
+
+    for (cv::Size size : {cv::Size(4000, 3000), cv::Size(6000, 4000), cv::Size(8000, 6000)}) {
+        run(size, steps, screen);
+    }
+}
@@ -0,0 +1,114 @@
+#include "../include/algorithms.h"
+#include "../include/lut.h"
+#include "../include/pipeline.h"
+
+#include <iostream>
+
+using namespace image_algorithms;
+
+namespace {
+    template<typename F>
+    double time_ms(F f, int runs) {
+        cv::TickMeter tm;
+        for (int i = 0; i < runs; ++i) {
+            tm.start();
+            f();
+            tm.stop();
+        }
+        return tm.getTimeMilli() / runs;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 24 MP by default
+    int cols = argc > 1 ? std::stoi(argv[1]) : 6000;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 4000;
+    int runs = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    std::vector<std::shared_ptr<const Command>> commands = {
+            std::make_shared<Brighten>(20),
+            std::make_shared<Contrast>(30),
+            std::make_shared<Tint>(-10),
+            std::make_shared<Temperature>(15),
+            std::make_shared<Saturate>(40),
+    };
+
+    Pipeline pipeline(commands);
+
+    cv::Mat chained, fused;
+    double chained_ms = time_ms([&]() {
+        chained = image;
+        for (const auto& command : commands) {
+            chained = command->execute(chained);
+        }
+    }, runs);
+    double fused_ms = time_ms([&]() { fused = pipeline.execute(image); }, runs);
+
+    double max_diff = cv::norm(chained, fused, cv::NORM_INF);
+
+    std::cout << cols << "x" << rows << ", " << commands.size() << " adjustments, "
+              << pipeline.size() << " pass(es) after compilation" << std::endl;
+    std::cout << "chained execute(): " << chained_ms << " ms" << std::endl;
+    std::cout << "fused pipeline:    " << fused_ms << " ms" << std::endl;
+    std::cout << "speedup:           " << chained_ms / fused_ms << "x" << std::endl;
+    std::cout << "max abs diff:      " << max_diff << std::endl;
+
+    // affine adjustments only, folded into one 3x4 matrix
+    std::vector<std::shared_ptr<const Command>> affine = {
+            std::make_shared<Contrast>(30),
+            std::make_shared<Tint>(-10),
+            std::make_shared<Temperature>(15),
+            std::make_shared<Saturate>(40),
+            std::make_shared<ApplyColor>(200, 120, 40, 0.1),
+    };
+
+    Pipeline folded(affine), linear(affine, true);
+    cv::Mat folded_result, linear_result;
+    double affine_chained_ms = time_ms([&]() {
+        chained = image;
+        for (const auto& command : affine) {
+            chained = command->execute(chained);
+        }
+    }, runs);
+    double folded_ms = time_ms([&]() { folded_result = folded.execute(image); }, runs);
+    double linear_ms = time_ms([&]() { linear_result = linear.execute(image); }, runs);
+
+    std::cout << std::endl << affine.size() << " affine adjustments" << std::endl;
+    std::cout << "chained execute(): " << affine_chained_ms << " ms" << std::endl;
+    std::cout << "folded matrix:     " << folded_ms << " ms" << std::endl;
+    std::cout << "in linear light:   " << linear_ms << " ms" << std::endl;
+    std::cout << "max abs diff:      " << cv::norm(chained, folded_result, cv::NORM_INF) << std::endl;
+
+    // HSV / Lab adjustments, baked into a 3D LUT
+    for (size_t count = 1; count <= 3; ++count) {
+        std::vector<std::shared_ptr<const Command>> color_ops = {
+                std::make_shared<Hue>(10),
+                std::make_shared<Lighten>(15),
+                std::make_shared<Brighten>(-10),
+        };
+        color_ops.resize(count);
+
+        double bake_ms = time_ms([&]() { Lut3D lut(color_ops); }, runs);
+        Lut3D lut(color_ops);
+
+        double color_chained_ms = time_ms([&]() {
+            chained = image;
+            for (const auto& command : color_ops) {
+                chained = command->execute(chained);
+            }
+        }, runs);
+        double lut_ms = time_ms([&]() { fused = lut.execute(image); }, runs);
+
+        std::cout << std::endl << count << " color op(s)" << std::endl;
+        std::cout << "chained execute(): " << color_chained_ms << " ms" << std::endl;
+        std::cout << "3D LUT bake:       " << bake_ms * 1000 << " us" << std::endl;
+        std::cout << "3D LUT apply:      " << lut_ms << " ms" << std::endl;
+        std::cout << "mean abs diff:     " << cv::norm(chained, fused, cv::NORM_L1) / chained.total() / 3
+                  << std::endl;
+    }
+
+    return 0;
+}
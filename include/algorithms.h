@@ -8,6 +8,10 @@
 #include "opencv2/opencv.hpp"
 #include "opencv2/highgui/highgui.hpp"
 
+#include <array>
+#include <memory>
+#include <string>
+
 namespace image_algorithms {
     /**
      * First argument -- src image
@@ -16,9 +20,98 @@ namespace image_algorithms {
      */
 
 
+    struct PointOp;
+
     class Command {
     public:
+        virtual ~Command() = default;
+
         virtual cv::Mat execute(const cv::Mat& image) const = 0;
+
+        /**
+         * Result of the command in dst, reused if it has the right size and type
+         *
+         * dst may share pixels with image only if in_place().
+         * Point ops run one fused pass over 8-bit images,
+         * other commands fall back to execute()
+         */
+        virtual void execute_into(const cv::Mat& image, cv::Mat& dst) const;
+
+        /**
+         * True if execute_into() may write its result over the image
+         */
+        virtual bool in_place() const;
+
+        /**
+         * Describes command as a per-pixel transform
+         *
+         * Returns false if it is not a point op
+         */
+        virtual bool point_op(PointOp& op) const;
+
+        /**
+         * True if result of a pixel depends only on its color
+         */
+        virtual bool is_color_op() const;
+
+        /**
+         * Applies command in place to CV_32FC3 BGR colors in [0, 1]
+         *
+         * Use only if is_color_op()
+         */
+        virtual void apply_to_colors(cv::Mat& colors) const;
+
+        /**
+         * True if a region of the result depends only on the same
+         * region of the image widened by halo() pixels
+         *
+         * Result of a tileable command has the size of the image
+         */
+        virtual bool is_tileable() const;
+
+        /**
+         * Pixels around a region needed to compute it
+         */
+        virtual int halo() const;
+
+        /**
+         * True if command only moves pixels around,
+         * i.e. resamples the image with a transform
+         */
+        virtual bool is_warp() const;
+
+        /**
+         * Sets transform from pixel coordinates of an image of size input
+         * to the ones of the result and the size of the result
+         *
+         * Use only if is_warp()
+         */
+        virtual void warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const;
+
+        /**
+         * Same command for the image downscaled by scale
+         *
+         * Returns nullptr if command doesn't depend on image size
+         */
+        virtual std::shared_ptr<const Command> scaled(double scale) const;
+
+        /**
+         * Name of the command in recipes,
+         * empty if it can not be written to one
+         */
+        virtual std::string name() const;
+
+        /**
+         * Writes parameters into the current map of fs,
+         * read() of the command restores them
+         */
+        virtual void write(cv::FileStorage& fs) const;
+
+        /**
+         * Command and its parameters as a cache key,
+         * empty if results of the command must not be cached
+         */
+        virtual std::string key() const;
     };
 
     /**
@@ -33,12 +126,39 @@ namespace image_algorithms {
      */
     cv::Mat takePicture(cv::VideoCapture camera);
 
+    // largest value of a channel of the depth, float images are in [0, 1]
+    double value_range(int depth);
+
+    /**
+     * Reads an image as it is stored: gray images
+     * stay single-channel, 16-bit ones keep their depth
+     */
+    cv::Mat read_image(const std::string& path);
+
+    /**
+     * Decodes image at 1/factor of its size, factor is 2, 4 or 8.
+     * JPEG decoders scale in the DCT domain, which is many times
+     * faster than a full decode, other formats are decoded in full
+     * and resized. Result is always 8-bit BGR
+     */
+    cv::Mat read_image_reduced(const std::string& path, int factor);
+
+    /**
+     * Writes image, deeper than 8-bit images are
+     * scaled down for formats that can't hold them
+     */
+    bool write_image(const std::string& path, const cv::Mat& image);
+
     /**
      * Does nothing -- use to open image
      */
     class Nothing : public Command {
     public:
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
     };
 
 
@@ -55,11 +175,23 @@ namespace image_algorithms {
 
     public:
         // width + x <= cols,
-        // height + y <= rows
+        // height + y <= rows, both at least 1
         Crop(int width, int height, int x = 0, int y = 0);
 
         cv::Mat execute(const cv::Mat& image) const override;
 
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool is_warp() const override;
+
+        void warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const override;
+
+        std::shared_ptr<const Command> scaled(double scale) const override;
+
     };
 
     /**
@@ -75,6 +207,16 @@ namespace image_algorithms {
 
         cv::Mat execute(const cv::Mat& image) const override;
 
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool is_warp() const override;
+
+        void warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const override;
+
     };
 
     /**
@@ -89,6 +231,14 @@ namespace image_algorithms {
         Saturate(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool point_op(PointOp& op) const override;
     };
 
     /**
@@ -103,6 +253,14 @@ namespace image_algorithms {
         Brighten(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool point_op(PointOp& op) const override;
     };
 
 
@@ -118,6 +276,16 @@ namespace image_algorithms {
         Lighten(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool is_color_op() const override;
+
+        void apply_to_colors(cv::Mat& colors) const override;
     };
 
 
@@ -133,6 +301,16 @@ namespace image_algorithms {
         Hue(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool is_color_op() const override;
+
+        void apply_to_colors(cv::Mat& colors) const override;
     };
 
 
@@ -148,6 +326,14 @@ namespace image_algorithms {
         Contrast(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool point_op(PointOp& op) const override;
     };
 
 
@@ -161,23 +347,50 @@ namespace image_algorithms {
      */
     cv::Mat hsv_add_scalar(const cv::Mat& image, int l, int a = 0, int b = 0);
 
+    /**
+     * image_1 * alpha + image_2 * (1 - alpha) on the common top left part
+     *
+     * Works on views of both images, dst is reused if it has
+     * the right size and type, so such calls allocate nothing
+     */
+    void blend(const cv::Mat& image_1, const cv::Mat& image_2, double alpha, cv::Mat& dst);
+
+    /**
+     * image * (1 - alpha) + color * alpha
+     *
+     * The color is never stored as an image, 8-bit images go through
+     * a table per channel. dst is reused as in blend
+     */
+    void apply_color(const cv::Mat& image, int r, int g, int b, double alpha, cv::Mat& dst);
+
 
     /**
      * Black and white filter
+     *
+     * Result of a BGR image has a single channel,
+     * so later commands work on a third of the data
      */
     class Gray : public Command {
     public:
         cv::Mat execute(const cv::Mat& image) const override;
 
+        bool point_op(PointOp& op) const override;
+
+        std::string name() const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
     };
 
 
     /**
      * Blends two images with given ratio
+     *
+     * Result has the size of the common top left part
      */
     class Blend : public Command {
     private:
-        const cv::Mat& image_2;
+        cv::Mat image_2;
         double value;
 
     public:
@@ -185,6 +398,16 @@ namespace image_algorithms {
 
         cv::Mat execute(const cv::Mat& image_1) const override;
 
+        void execute_into(const cv::Mat& image_1, cv::Mat& dst) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        std::string key() const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
     };
 
 
@@ -201,6 +424,14 @@ namespace image_algorithms {
 
         cv::Mat execute(const cv::Mat& image) const override;
 
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool point_op(PointOp& op) const override;
+
     };
 
 
@@ -216,38 +447,91 @@ namespace image_algorithms {
         Temperature(int value);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool point_op(PointOp& op) const override;
     };
 
 
     /**
      * Blurs image
      *
-     * Use double value in (0, 5]
+     * value is sigma of the gaussian, (0, 5] in the editor,
+     * up to hundreds with the recursive method
      */
     class Blur : public Command {
+    public:
+        enum class Method {
+            // recursive from recursive_threshold on, exact below
+            Auto,
+            // GaussianBlur, cost grows with sigma
+            Exact,
+            // recursive_blur, cost does not depend on sigma
+            Recursive
+        };
+
+        // sigma from which Auto uses the recursive filter
+        static constexpr double recursive_threshold = 8;
+
     private:
         double value;
+        Method method;
+
+        [[nodiscard]] bool recursive() const;
 
     public:
-        Blur(double value = 3);
+        Blur(double value = 3, Method method = Method::Auto);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        std::shared_ptr<const Command> scaled(double scale) const override;
+
+        bool is_tileable() const override;
+
+        int halo() const override;
     };
 
 
     /**
      * Sharpens image
      *
-     * Use |value| <= 1
+     * Use |value| <= 1, sigma is the blur subtracted from image
      */
     class Sharpen : public Command {
     private:
         double value;
+        double sigma;
+        double threshold;
+        bool luminance;
 
     public:
-        Sharpen(double value = 0.5);
+        // threshold and luminance as in unsharp_mask
+        Sharpen(double value = 0.5, double sigma = 3, double threshold = 0, bool luminance = false);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        std::shared_ptr<const Command> scaled(double scale) const override;
+
+        bool is_tileable() const override;
+
+        int halo() const override;
     };
 
     /**
@@ -265,17 +549,55 @@ namespace image_algorithms {
         ApplyColor(int r, int g, int b, double alpha = 0.1);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        void execute_into(const cv::Mat& image, cv::Mat& dst) const override;
+
+        bool point_op(PointOp& op) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
     };
 
+    /**
+     * Moves corners of the image to outputQuad,
+     * given in pixels of the image
+     */
     class TransformPerspective : public Command {
+    public:
+        /**
+         * Size of the result
+         */
+        enum class Frame {
+            // same as the image, parts outside of it are cut off
+            Image,
+            // bounding box of outputQuad, nothing is cut off
+            Quad
+        };
+
     private:
-        cv::Point2f* outputQuad;
+        std::array<cv::Point2f, 4> outputQuad;
+        Frame frame;
 
     public:
         // use value <= 0.4
-        TransformPerspective(cv::Point2f* outputQuad);
+        TransformPerspective(const cv::Point2f outputQuad[4], Frame frame = Frame::Image);
 
         cv::Mat execute(const cv::Mat& image) const override;
+
+        std::shared_ptr<const Command> scaled(double scale) const override;
+
+        std::string name() const override;
+
+        void write(cv::FileStorage& fs) const override;
+
+        static std::shared_ptr<const Command> read(const cv::FileNode& node);
+
+        bool is_warp() const override;
+
+        void warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const override;
     };
 }
 
@@ -0,0 +1,79 @@
+#ifndef PHOTOEDITOR_BATCH_H
+#define PHOTOEDITOR_BATCH_H
+
+#include "recipe.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace batch {
+
+    using image_algorithms::Recipe;
+
+    /**
+     * Parses a recipe like "brighten=20,saturate=40,crop=800:600:0:0"
+     *
+     * Names are the ones of the commands in lower case, arguments
+     * are separated by ':'. text may also be a path to a .json, .yml
+     * or .xml recipe file, see image_algorithms::read_recipe.
+     * Returns false and sets error on bad input
+     */
+    bool parse_recipe(const std::string& text, Recipe& recipe, std::string& error);
+
+    struct Options {
+        std::vector<std::string> inputs;
+        std::string output_dir;
+        // extension of the results without a dot, empty keeps the input one
+        std::string format;
+        Recipe recipe;
+        // threads of every stage
+        int workers = 2;
+        // images waiting between two stages
+        size_t queue_size = 8;
+        // point adjustments work on linear light instead of sRGB values
+        bool linear_light = false;
+    };
+
+    struct Report {
+        size_t done = 0;
+        size_t failed = 0;
+        double seconds = 0;
+
+        // why inputs failed, "path: reason" for every one
+        std::vector<std::string> errors;
+
+        // busy time of a stage summed over its threads
+        double decode_seconds = 0;
+        double process_seconds = 0;
+        double encode_seconds = 0;
+    };
+
+    /**
+     * Expands glob patterns (*, ?, [...]) in inputs,
+     * other paths are kept as they are
+     */
+    std::vector<std::string> expand_inputs(const std::vector<std::string>& inputs);
+
+    /**
+     * Paths the results of inputs are written to, in order of inputs
+     *
+     * Returns false and sets error if two inputs would be written
+     * to the same path or a result would overwrite an input
+     */
+    bool output_paths(const Options& options, std::vector<std::string>& paths, std::string& error);
+
+    /**
+     * Applies recipe to every input and writes results to output_dir
+     *
+     * Nothing is processed if output_paths fails, every input
+     * counts as failed then and errors holds the reason
+     *
+     * Decoding, processing and encoding run as separate stages
+     * with their own threads connected by bounded queues, so
+     * one image is decoded while another one is processed
+     */
+    Report run(const Options& options);
+}
+
+#endif //PHOTOEDITOR_BATCH_H
@@ -0,0 +1,96 @@
+#ifndef PHOTOEDITOR_BUFFERPOOL_H
+#define PHOTOEDITOR_BUFFERPOOL_H
+
+#include "opencv2/opencv.hpp"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace image_algorithms {
+
+    struct BufferPoolPolicy {
+        // bytes of released buffers kept for reuse
+        size_t budget = size_t(512) << 20;
+        // smaller buffers go to the usual allocator
+        size_t min_bytes = size_t(256) << 10;
+        // buffers of at least this size are backed by
+        // transparent huge pages, 0 disables them
+        size_t huge_page_bytes = size_t(2) << 20;
+        // touch every page of a new buffer before handing it out
+        bool prefault = false;
+    };
+
+    /**
+     * Allocator of image buffers that keeps released ones for reuse
+     *
+     * Buffers are pooled by size class (steps of 1/8 of a power of two),
+     * so temporaries of the same frame size come back without mmap,
+     * munmap and page faults. Large buffers are aligned to and
+     * advised as huge pages. Small ones are left to cv::fastMalloc
+     */
+    class BufferPool : public cv::MatAllocator {
+    public:
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            // bytes of buffers handed out and not released yet
+            size_t outstanding = 0;
+            size_t peak = 0;
+            // bytes of released buffers waiting for reuse
+            size_t pooled = 0;
+        };
+
+        explicit BufferPool(BufferPoolPolicy policy = BufferPoolPolicy());
+
+        ~BufferPool() override;
+
+        BufferPool(const BufferPool&) = delete;
+
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                               cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+
+        bool allocate(cv::UMatData* data, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+
+        void deallocate(cv::UMatData* data) const override;
+
+        /**
+         * Makes the pool the allocator of every Mat created from now on
+         */
+        void install();
+
+        void set_policy(const BufferPoolPolicy& policy);
+
+        // unmaps every pooled buffer
+        void trim();
+
+        [[nodiscard]] Stats stats() const;
+
+        /**
+         * Pool shared by the editor and batch mode
+         *
+         * Never destroyed, so images released at exit can still go back to it
+         */
+        static BufferPool& instance();
+
+    private:
+        mutable std::mutex mutex;
+        BufferPoolPolicy policy;
+        // size class -> released buffers
+        mutable std::map<size_t, std::vector<void*>> free;
+        // mapped length of every buffer handed out
+        mutable std::unordered_map<void*, size_t> lengths;
+        mutable Stats counters;
+
+        // pooled or newly mapped buffer, nullptr if it is too small to pool
+        void* take(size_t bytes) const;
+
+        // false if buffer was not taken from the pool
+        bool give_back(void* buffer) const;
+    };
+}
+
+#endif //PHOTOEDITOR_BUFFERPOOL_H
@@ -6,11 +6,16 @@
 #define PHOTOEDITOR_CONTROLLER_H
 
 #include "algorithms.h"
+#include "history.h"
+#include "tiles.h"
 #include <memory>
+#include <mutex>
 
 namespace controller {
     class Controller {
     public:
+        // memory_budget of policy also covers the cache of previews
+        explicit Controller(HistoryPolicy policy = HistoryPolicy());
 
         void open_image(const cv::Mat& image);
 
@@ -18,6 +23,19 @@ namespace controller {
 
         [[nodiscard]] bool can_redo() const;
 
+        // bytes of history kept in memory
+        [[nodiscard]] size_t resident_bytes() const;
+
+        // bytes of history paged out to disk
+        [[nodiscard]] size_t spilled_bytes() const;
+
+        // result caches of history and previews together
+        [[nodiscard]] image_algorithms::ResultCache::Stats cache_stats() const;
+
+        // edits of the shown image since it was opened
+        [[nodiscard]] image_algorithms::Recipe recipe() const;
+
+        // empty if history could not rebuild the version
         cv::Mat undo();
 
         cv::Mat redo();
@@ -48,25 +66,65 @@ namespace controller {
 
         cv::Mat sharpen(const cv::Mat& image, double value);
 
-        cv::Mat transform_perspective(const cv::Mat& image, cv::Point2f outputQuad[4]);
+        cv::Mat transform_perspective(const cv::Mat& image, const cv::Point2f outputQuad[4]);
 
         cv::Mat apply_color(const cv::Mat& image, int r, int g, int b, double alpha);
 
+        /**
+         * Preview session of one adjustment
+         *
+         * begin_preview() remembers the source, update_preview() the newest
+         * parameters. Previews never add versions: commit_preview() renders
+         * the last command as one new version, rollback_preview() hands
+         * the untouched source back without copying it
+         */
+        void begin_preview(const cv::Mat& image);
+
+        void update_preview(std::shared_ptr<const image_algorithms::Command> command);
+
+        /**
+         * Renders command on image (usually a proxy of the source)
+         *
+         * Previews alternate between two scratch buffers, so the next
+         * one is rendered while the last one is shown and neither is
+         * allocated again during a drag. A returned buffer is not
+         * rendered into again until it is passed to release_preview()
+         *
+         * Safe to call from a render thread, returns empty Mat if cancelled
+         */
+        cv::Mat render_preview(const std::shared_ptr<const image_algorithms::Command>& command,
+                               const cv::Mat& image, const image_algorithms::Cancelled& cancelled = nullptr);
+
+        // preview returned by render_preview is not read anymore, e.g. it was replaced on screen
+        void release_preview(const cv::Mat& preview);
+
+        cv::Mat commit_preview();
+
+        cv::Mat rollback_preview();
+
+        [[nodiscard]] bool in_preview() const;
+
 
     private:
-        struct Version : public image_algorithms::Command {
-            explicit Version(const image_algorithms::Command& command);
+        History history;
+        image_algorithms::TileScheduler scheduler;
+
+        bool previewing = false;
+        cv::Mat preview_source;
+        std::shared_ptr<const image_algorithms::Command> preview_command;
 
-            [[nodiscard]] cv::Mat execute(const cv::Mat& image) const override;
+        std::mutex scratch_mutex;
+        cv::Mat scratch[2];
+        // returned by render_preview and not released yet
+        bool handed_out[2] = {false, false};
+        int next_scratch = 0;
 
-            const image_algorithms::Command& command;
-            cv::Mat mat;
-        };
+        // slider positions seen before are looked up
+        image_algorithms::ResultCache preview_cache;
 
-        int current_version = 0;
-        std::deque<Version> versions;
+        void end_preview();
 
-        cv::Mat execute(const image_algorithms::Command& command, const cv::Mat& image);
+        cv::Mat execute(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat& image);
     };
 
 }
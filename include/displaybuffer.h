@@ -0,0 +1,60 @@
+#ifndef PHOTOEDITOR_DISPLAYBUFFER_H
+#define PHOTOEDITOR_DISPLAYBUFFER_H
+
+#include <QImage>
+
+#include "opencv2/core/mat.hpp"
+
+/**
+ * Format an image of given type is painted from: Format_RGB32,
+ * Format_ARGB32_Premultiplied for 4 channels. The raster engine
+ * draws both without converting them first
+ */
+QImage::Format displayFormat(int type);
+
+/**
+ * Writes pixels of source into target at given position in one pass,
+ * channels are reordered, alpha premultiplied and 16-bit and float
+ * images scaled on the way
+ */
+void convertForDisplay(const cv::Mat &source, QImage &target, const cv::Point &at);
+
+
+/**
+ * Display-ready copy of an image, converted only where it is painted
+ *
+ * A new source makes the whole buffer dirty, prepare() converts dirty
+ * blocks of the rect about to be painted, so parts out of view cost
+ * nothing. The buffer is reused while size and format stay the same,
+ * slider ticks do not allocate or convert whole frames
+ */
+class DisplayBuffer {
+public:
+    void reset(const cv::Mat &source);
+
+    // drops source and buffer
+    void clear();
+
+    /**
+     * Converts dirty pixels of rect of source
+     *
+     * Returns buffer of source size, up to date inside rect
+     */
+    const QImage &prepare(const cv::Rect &rect);
+
+    [[nodiscard]] bool empty() const;
+
+    [[nodiscard]] cv::Size size() const;
+
+private:
+    // side of a block of dirty flags
+    static const int blockSize = 64;
+
+    // kept alive, it is converted lazily
+    cv::Mat source;
+    QImage buffer;
+    // one flag per block, non-zero if it has to be converted
+    cv::Mat dirty;
+};
+
+#endif //PHOTOEDITOR_DISPLAYBUFFER_H
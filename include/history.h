@@ -0,0 +1,173 @@
+#ifndef PHOTOEDITOR_HISTORY_H
+#define PHOTOEDITOR_HISTORY_H
+
+#include "algorithms.h"
+#include "recipe.h"
+#include "resultcache.h"
+#include "spill.h"
+#include "tiles.h"
+#include "tilestore.h"
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace controller {
+
+    /**
+     * When History keeps images of its versions
+     */
+    struct HistoryPolicy {
+        // bytes of memory of the history, keyframes and result cache
+        // together. Oldest keyframes are paged out to disk above it,
+        // or dropped without a disk budget
+        size_t memory_budget = size_t(1) << 30;
+
+        // bytes of keyframes paged out, oldest versions are dropped
+        // above it. 0 drops them instead of paging out
+        size_t disk_budget = size_t(8) << 30;
+
+        // versions between two keyframes
+        int keyframe_interval = 8;
+
+        // seconds a replay from the nearest keyframe may take
+        double max_replay_seconds = 0.25;
+
+        // bytes of recent results looked up instead of rendered
+        // again on undo, redo and repeated edits, taken out of
+        // memory_budget. 0 disables it
+        size_t cache_budget = size_t(256) << 20;
+    };
+
+    /**
+     * Undo history stored as a log of commands
+     *
+     * Only keyframes keep their image, other versions are rebuilt
+     * by replaying commands from the nearest keyframe before them.
+     * Keyframes are stored in tiles, tiles they have in common are
+     * stored once, so history grows with the pixels that changed.
+     * A version becomes a keyframe when its input is not the previous
+     * version or when the replay up to it would get too long or too slow.
+     * A warp right after a warp that resampled is composed with it into
+     * one Warp, so a rotate after a rotate resamples the image once
+     *
+     * Cold keyframes go to a SpillFile and are paged back on undo,
+     * the one the next undo needs is paged in in the background
+     */
+    class History {
+    public:
+        explicit History(HistoryPolicy policy = HistoryPolicy());
+
+        /**
+         * Runs command on input and adds the result as a new version
+         * after the current one, versions that could be redone are dropped
+         */
+        cv::Mat execute(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat& input);
+
+        [[nodiscard]] bool can_undo() const;
+
+        [[nodiscard]] bool can_redo() const;
+
+        /**
+         * Image of the previous version, empty if its keyframe
+         * could not be paged in. The shown version stays then
+         */
+        cv::Mat undo();
+
+        // same as undo, for the next version
+        cv::Mat redo();
+
+        [[nodiscard]] size_t size() const;
+
+        // bytes of keyframes in memory
+        [[nodiscard]] size_t resident_bytes() const;
+
+        // bytes of keyframes paged out to disk
+        [[nodiscard]] size_t spilled_bytes() const;
+
+        [[nodiscard]] size_t keyframe_count() const;
+
+        [[nodiscard]] image_algorithms::ResultCache::Stats cache_stats() const;
+
+        /**
+         * Commands that made the shown version from the image
+         * they started from, i.e. the last one opened.
+         * Starts at the oldest version if that one was dropped
+         */
+        [[nodiscard]] image_algorithms::Recipe recipe() const;
+
+    private:
+        struct Version {
+            std::shared_ptr<const image_algorithms::Command> command;
+            // image of a keyframe in memory
+            image_algorithms::TiledImage keyframe;
+            bool in_memory = false;
+            // time command took to run
+            double seconds = 0;
+            // set if this is a paged out keyframe
+            std::shared_ptr<const image_algorithms::SpilledImage> spilled;
+            // input of command was not the previous version
+            bool restart = false;
+            // warp rendered together with the warps before it,
+            // from the input of the first of them
+            bool composed = false;
+            // warp that resampled its input
+            bool resampled = false;
+
+            [[nodiscard]] bool is_keyframe() const;
+        };
+
+        HistoryPolicy policy;
+        image_algorithms::TileScheduler scheduler;
+        image_algorithms::TileStore store;
+        image_algorithms::ResultCache cache;
+        std::unique_ptr<image_algorithms::SpillFile> spill_file;
+
+        std::deque<Version> versions;
+        // number of versions up to the shown one
+        size_t current = 0;
+        // image of versions[current - 1]
+        cv::Mat shown;
+
+        // paged in keyframe, ready or on the way
+        std::shared_ptr<const image_algorithms::SpilledImage> prefetched_from;
+        std::shared_future<cv::Mat> prefetched;
+
+        // command on image through the cache, seconds is the time it took to render
+        cv::Mat run(const image_algorithms::Command& command, const cv::Mat& image, double& seconds);
+
+        [[nodiscard]] bool needs_keyframe(double seconds) const;
+
+        void keep(Version& version, const cv::Mat& image);
+
+        // index of the nearest keyframe at or before index a replay up to index can start from
+        [[nodiscard]] size_t keyframe_before(size_t index) const;
+
+        // first version of the warps composed into versions[index]
+        [[nodiscard]] size_t warps_from(size_t index) const;
+
+        // commands of versions [first, last)
+        [[nodiscard]] std::vector<std::shared_ptr<const image_algorithms::Command>> commands(size_t first, size_t last) const;
+
+        cv::Mat rebuild(size_t index);
+
+        cv::Mat load(const Version& version);
+
+        void prefetch(const std::shared_ptr<const image_algorithms::SpilledImage>& spilled);
+
+        void enforce_budget();
+
+        // part of memory_budget left for keyframes
+        [[nodiscard]] size_t keyframe_budget() const;
+
+        bool spill_oldest();
+
+        // false if the oldest keyframe is the one the shown version is replayed from
+        bool drop_oldest();
+
+        void forget_dropped_prefetch();
+    };
+}
+
+#endif //PHOTOEDITOR_HISTORY_H
@@ -0,0 +1,19 @@
+#ifndef PHOTOEDITOR_IIRBLUR_H
+#define PHOTOEDITOR_IIRBLUR_H
+
+#include "opencv2/opencv.hpp"
+
+namespace image_algorithms {
+
+    /**
+     * Gaussian blur by the recursive filter of Young and van Vliet
+     *
+     * Cost per pixel does not depend on sigma, so it is the one to use
+     * for sigma in the tens and hundreds. Differs from GaussianBlur
+     * by a few levels of 8-bit images, borders are replicated.
+     * Works on any number of channels, sigma has to be >= 0.5
+     */
+    cv::Mat recursive_blur(const cv::Mat& image, double sigma);
+}
+
+#endif //PHOTOEDITOR_IIRBLUR_H
@@ -12,7 +12,10 @@
 #include "opencv2/imgproc/types_c.h"
 #include "imgur.h"
 #include "controller.h"
+#include "preview.h"
+#include "renderworker.h"
 #include "sliders.h"
+#include "zoomanimator.h"
 
 #if defined(QT_PRINTSUPPORT_LIB)
 
@@ -30,16 +33,18 @@
 QT_BEGIN_NAMESPACE
 class QAction;
 
-class QLabel;
-
 class QMenu;
 
 class QScrollArea;
 
 class QScrollBar;
 
+class QImageReader;
+
 QT_END_NAMESPACE
 
+class ImageViewport;
+
 
 class ImageViewer : public QMainWindow {
 Q_OBJECT
@@ -51,10 +56,6 @@ public:
 
 private slots:
 
-    void scalingTime(qreal x);
-
-    void animFinished();
-
     void open();
 
     void undo();
@@ -63,6 +64,8 @@ private slots:
 
     void saveAs();
 
+    void saveRecipe();
+
     void uploadToImgur();
 
     void print();
@@ -79,6 +82,14 @@ private slots:
 
     void cancel();
 
+    void applyPreview();
+
+    void previewRendered(const cv::Mat& preview, quint64 generation);
+
+    void imageLoaded(const cv::Mat& loaded, quint64 generation);
+
+    void loadFailed(quint64 generation);
+
     void applyTint();
 
     void applySaturation();
@@ -113,6 +124,8 @@ private slots:
 
     void temperature(int ratio);
 
+    void zoomed(double scale, bool settled);
+
     void zoomIn();
 
     void zoomOut();
@@ -134,22 +147,45 @@ private:
 
     void setImage(const cv::Mat& new_image);
 
+    bool loadReduced(const QString& fileName, QImageReader& reader);
+
+    void preview(std::shared_ptr<const image_algorithms::Command> command);
+
+    void render(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat& source);
+
+    void showPreview(const cv::Mat& preview);
+
+    // hands the buffer of the preview on screen back to controller
+    void releasePreview();
+
+    cv::Size displaySize() const;
+
     void scaleImage(double factor);
 
+    void stopZoom();
+
     void adjustScrollBar(QScrollBar* scrollBar, double factor);
 
     void wheelEvent(QWheelEvent* event) override;
 
     cv::Mat image;
-    cv::Mat oldImage;
-    cv::Mat croppedOldImage;
     cv::Mat blendImage;
     controller::Controller controller;
-    QLabel* imageLabel;
+    image_algorithms::PreviewPyramid pyramid;
+    image_algorithms::PreviewPyramid blendPyramid;
+    // scale of the proxy previews are rendered from
+    double previewScale = 1;
+    // preview the viewport shows, rendered by controller
+    cv::Mat shownPreview;
+    // renders through controller, so it has to go first
+    RenderWorker renderWorker;
+    // decodes opened files at full resolution
+    RenderWorker loadWorker;
+    QString loadingFile;
+    ImageViewport* viewport;
     QScrollArea* scrollArea;
     double scaleFactor = 1;
-    double tmpFactor = 1;
-    int _numScheduledScalings = 1;
+    ZoomAnimator zoomAnimator;
 
 #if defined(QT_PRINTSUPPORT_LIB) && QT_CONFIG(printer)
     QPrinter printer;
@@ -171,6 +207,7 @@ private:
     QAction* undoAct;
     QAction* redoAct;
     QAction* saveAsAct;
+    QAction* saveRecipeAct;
     QAction* uploadToImgurAct;
     QAction* printAct;
     QAction* copyAct;
@@ -247,6 +284,15 @@ inline QImage cvMatToQImage(const cv::Mat& inMat) {
         }
 
         default:
+            // 16-bit and float images are shown as 8-bit ones
+            if (inMat.depth() == CV_16U || inMat.depth() == CV_32F) {
+                cv::Mat image8;
+                inMat.convertTo(image8, CV_8U, inMat.depth() == CV_16U ? 1 / 257.0 : 255);
+
+                // pixels of image8 are gone after return
+                return cvMatToQImage(image8).copy();
+            }
+
             qWarning() << "ASM::cvMatToQImage() - cv::Mat image type not handled in switch:" << inMat.type();
             break;
     }
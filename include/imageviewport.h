@@ -0,0 +1,92 @@
+#ifndef PHOTOEDITOR_IMAGEVIEWPORT_H
+#define PHOTOEDITOR_IMAGEVIEWPORT_H
+
+#include <QImage>
+#include <QWidget>
+
+#include <list>
+#include <unordered_map>
+
+#include "opencv2/core/mat.hpp"
+#include "displaybuffer.h"
+#include "preview.h"
+
+QT_BEGIN_NAMESPACE
+class QPainter;
+
+class QPaintEvent;
+
+QT_END_NAMESPACE
+
+/**
+ * Widget that shows an image at the scale of its own size
+ *
+ * Only the part being painted is drawn, from the smallest level of
+ * the pyramid that is not coarser than the screen. Converted tiles
+ * of the levels are kept, so panning and zooming within a level
+ * reuse them instead of converting and scaling the whole image
+ *
+ * While animated, a frame converts tiles only for a fixed budget,
+ * the rest is drawn from a small overview of the image, and pixels
+ * are not filtered. Full quality comes back with the last frame
+ */
+class ImageViewport : public QWidget {
+Q_OBJECT
+
+public:
+    // pyramid of the shown image, owned by the caller
+    explicit ImageViewport(image_algorithms::PreviewPyramid &pyramid, QWidget *parent = nullptr);
+
+    /**
+     * Shows the image of the pyramid again after it was reset,
+     * drops tiles of the previous one and the preview
+     */
+    void showImage();
+
+    // shows preview stretched over the widget until showImage
+    void showPreview(const cv::Mat &preview);
+
+    // frames of a zoom animation, false repaints at full quality
+    void setAnimating(bool animating);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    struct Tile {
+        quint64 key;
+        QImage image;
+    };
+
+    // side of a tile in pixels of its level
+    static const int tileSize = 256;
+    // bytes of converted tiles kept
+    static const size_t tileBudget = size_t(128) << 20;
+    // time an animation frame may spend converting tiles
+    static const int frameBudgetMs = 8;
+    // long side of the overview, in pixels
+    static const int overviewSize = 1024;
+
+    void clearTiles();
+
+    // nullptr if it is not converted and there is no time left for it
+    const QImage *tile(const image_algorithms::Proxy &level, int tx, int ty, bool convert);
+
+    const QImage &overview();
+
+    void paintPreview(QPainter &painter, const QRect &exposed);
+
+    image_algorithms::PreviewPyramid &pyramid;
+    cv::Size fullSize;
+
+    DisplayBuffer preview;
+    bool animating = false;
+    QImage overviewImage;
+
+    // most recently used tiles first
+    std::list<Tile> tiles;
+    std::unordered_map<quint64, std::list<Tile>::iterator> tileIndex;
+    size_t tileBytes = 0;
+};
+
+#endif //PHOTOEDITOR_IMAGEVIEWPORT_H
@@ -0,0 +1,45 @@
+#ifndef PHOTOEDITOR_LUT_H
+#define PHOTOEDITOR_LUT_H
+
+#include "algorithms.h"
+
+#include <memory>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Chain of color ops baked into a 3D lookup table
+     *
+     * Table is built in float on a size^3 lattice, so it costs
+     * the same to apply whatever the number of baked commands,
+     * and rebuilding it touches only the lattice points
+     *
+     * Applied to CV_8UC3 images with tetrahedral interpolation,
+     * every other type is left to the original commands
+     */
+    class Lut3D : public Command {
+    private:
+        int size;
+        // size^3 BGR entries in [0, 255], blue index changes fastest
+        cv::Mat table;
+        std::vector<std::shared_ptr<const Command>> commands;
+
+    public:
+        // every command must be a color op
+        explicit Lut3D(std::vector<std::shared_ptr<const Command>> commands, int size = 33);
+
+        cv::Mat execute(const cv::Mat& image) const override;
+
+        void execute_into(const cv::Mat& image, cv::Mat& dst) const override;
+
+        // every pixel is read before it is written
+        bool in_place() const override;
+
+        bool is_color_op() const override;
+
+        void apply_to_colors(cv::Mat& colors) const override;
+    };
+}
+
+#endif //PHOTOEDITOR_LUT_H
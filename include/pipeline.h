@@ -0,0 +1,140 @@
+#ifndef PHOTOEDITOR_PIPELINE_H
+#define PHOTOEDITOR_PIPELINE_H
+
+#include "algorithms.h"
+
+#include <memory>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Per-pixel transform of a point adjustment
+     * on BGR values in [0, 255]
+     */
+    struct PointOp {
+        enum class Kind {
+            // bgr'[i] = sum_j matrix(i, j) * bgr[j] + matrix(i, 3)
+            Affine,
+            // adds shift to max(b, g, r) (HSV value),
+            // hue and saturation stay the same
+            Value
+        };
+
+        Kind kind = Kind::Affine;
+        cv::Matx34f matrix = cv::Matx34f(1, 0, 0, 0,
+                                         0, 1, 0, 0,
+                                         0, 0, 1, 0);
+        float shift = 0;
+
+        static PointOp affine(const cv::Matx34f& matrix);
+
+        static PointOp value(float shift);
+
+        // true if gray pixels stay gray, so gray images can stay single-channel
+        [[nodiscard]] bool keeps_gray() const;
+
+        // true if every pixel comes out gray
+        [[nodiscard]] bool makes_gray() const;
+
+        /**
+         * Affine op doing this one and then next as one matrix,
+         * nothing is clamped in between. Both must be affine
+         */
+        [[nodiscard]] PointOp then(const PointOp& next) const;
+    };
+
+    /**
+     * Applies op in place to CV_32FC3 BGR colors in [0, 1]
+     */
+    void apply_point_op(const PointOp& op, cv::Mat& colors);
+
+    /**
+     * True if apply_point_ops works on images of the type:
+     * 8 or 16 bits with 1 (gray), 3 (BGR) or 4 (BGRA) channels
+     */
+    bool has_point_kernel(int type);
+
+    /**
+     * Applies ops one after another in a single pass over the image into dst
+     *
+     * The kernel is specialized for every type has_point_kernel() accepts,
+     * 16-bit values are not rounded to 8 bits in between and alpha is
+     * copied as it is. Gray images stay single-channel unless an op
+     * gives them color, color ones become single-channel if the last
+     * op leaves only gray. A lone affine op is one cv::transform.
+     * Every pixel is read before it is written, so dst may be src itself
+     *
+     * With linear_light ops see sRGB values decoded to linear light
+     * through a table and their results are encoded back
+     */
+    void apply_point_ops(const std::vector<PointOp>& ops, const cv::Mat& src, cv::Mat& dst,
+                         bool linear_light = false);
+
+
+    /**
+     * Runs a sequence of point ops in one pass
+     * over the pixels into a single output buffer
+     *
+     * Consecutive affine ops (Gray, Saturate, Contrast, Tint,
+     * Temperature, ApplyColor) are multiplied into one 3x4 matrix,
+     * so a run of them costs a single cv::transform
+     *
+     * Works on the types of has_point_kernel(), every
+     * other type is left to the original commands
+     */
+    class FusedPointOps : public Command {
+    private:
+        std::vector<PointOp> ops;
+        std::vector<std::shared_ptr<const Command>> commands;
+        bool linear_light;
+
+    public:
+        // linear_light -- ops work on linear light instead of sRGB values
+        explicit FusedPointOps(std::vector<std::shared_ptr<const Command>> commands, bool linear_light = false);
+
+        cv::Mat execute(const cv::Mat& image) const override;
+
+        void execute_into(const cv::Mat& image, cv::Mat& dst) const override;
+
+        bool in_place() const override;
+
+        bool is_color_op() const override;
+
+        void apply_to_colors(cv::Mat& colors) const override;
+    };
+
+
+    /**
+     * Chain of commands executed one after another
+     *
+     * Consecutive point adjustments (Brighten, Contrast, Tint,
+     * Temperature, Saturate, Gray, ApplyColor) are compiled into one
+     * FusedPointOps pass, runs that also contain other color ops
+     * (Hue, Lighten) are baked into a Lut3D. Consecutive warps (Crop, RotateInFrame,
+     * TransformPerspective) become one Warp, resampled once
+     *
+     * Runs of tileable stages go tile by tile through TileScheduler
+     */
+    class Pipeline : public Command {
+    private:
+        std::vector<std::shared_ptr<const Command>> stages;
+
+    public:
+        // linear_light is passed to FusedPointOps, Lut3D stays in sRGB
+        explicit Pipeline(const std::vector<std::shared_ptr<const Command>>& commands, bool linear_light = false);
+
+        cv::Mat execute(const cv::Mat& image) const override;
+
+        void execute_into(const cv::Mat& image, cv::Mat& dst) const override;
+
+        bool is_tileable() const override;
+
+        int halo() const override;
+
+        // number of passes over the image after compilation
+        [[nodiscard]] size_t size() const;
+    };
+}
+
+#endif //PHOTOEDITOR_PIPELINE_H
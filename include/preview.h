@@ -0,0 +1,48 @@
+#ifndef PHOTOEDITOR_PREVIEW_H
+#define PHOTOEDITOR_PREVIEW_H
+
+#include "opencv2/opencv.hpp"
+
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Downscaled copy of an image
+     *
+     * scale -- proxy size / full size
+     */
+    struct Proxy {
+        cv::Mat image;
+        double scale = 1;
+    };
+
+    /**
+     * Pyramid of halved copies of an image used for previews
+     *
+     * Levels are built on demand, so keeping
+     * it next to an image costs nothing until used
+     */
+    class PreviewPyramid {
+    private:
+        // levels[0] is the full resolution image
+        std::vector<cv::Mat> levels;
+
+    public:
+        void reset(const cv::Mat& image);
+
+        /**
+         * Smallest level that covers given size,
+         * full resolution image if there is none
+         */
+        Proxy level(const cv::Size& size);
+
+        /**
+         * Smallest level with at least given scale,
+         * matches levels of a pyramid of another image
+         */
+        Proxy level(double scale);
+    };
+}
+
+#endif //PHOTOEDITOR_PREVIEW_H
@@ -0,0 +1,64 @@
+#ifndef PHOTOEDITOR_RECIPE_H
+#define PHOTOEDITOR_RECIPE_H
+
+#include "algorithms.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Edits applied one after another
+     */
+    using Recipe = std::vector<std::shared_ptr<const Command>>;
+
+    using CommandReader = std::shared_ptr<const Command> (*)(const cv::FileNode& node);
+
+    /**
+     * Makes commands named name readable from recipes,
+     * commands of this library are registered already
+     */
+    void register_command(const std::string& name, CommandReader reader);
+
+    /**
+     * Writes command as a map with its name and parameters
+     */
+    void write_command(cv::FileStorage& fs, const Command& command);
+
+    /**
+     * Restores a command written by write_command
+     */
+    std::shared_ptr<const Command> read_command(const cv::FileNode& node);
+
+    /**
+     * Writes recipe to path
+     *
+     * Format follows the extension: .json, .yml/.yaml or .xml,
+     * with .gz added the file is compressed. Images of commands
+     * like blend are stored as base64. Returns false if the file
+     * can not be written
+     */
+    bool write_recipe(const std::string& path, const Recipe& recipe);
+
+    /**
+     * Reads recipe written by write_recipe, unknown commands are errors
+     */
+    Recipe read_recipe(const std::string& path);
+
+    /**
+     * Same as write_recipe and read_recipe, but in memory.
+     * format is one of cv::FileStorage::FORMAT_*
+     */
+    std::string recipe_to_string(const Recipe& recipe, int format = cv::FileStorage::FORMAT_JSON);
+
+    Recipe recipe_from_string(const std::string& text);
+
+    /**
+     * Recipe for the image downscaled by scale, see Command::scaled
+     */
+    Recipe scaled(const Recipe& recipe, double scale);
+}
+
+#endif //PHOTOEDITOR_RECIPE_H
@@ -0,0 +1,64 @@
+#ifndef PHOTOEDITOR_RENDERWORKER_H
+#define PHOTOEDITOR_RENDERWORKER_H
+
+#include <QObject>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "opencv2/core/mat.hpp"
+#include "tiles.h"
+
+Q_DECLARE_METATYPE(cv::Mat)
+
+/**
+ * Renders previews on a background thread
+ *
+ * Only the newest job matters: posting a job replaces the one
+ * waiting and cancels the one being rendered. Result comes
+ * back through rendered() on the thread of the worker's owner,
+ * also the one of a job that finished after a newer one was
+ * posted. Receivers compare its generation with generation()
+ */
+class RenderWorker : public QObject {
+Q_OBJECT
+
+public:
+    // empty result means the job gave up
+    using Job = std::function<cv::Mat(const image_algorithms::Cancelled& cancelled)>;
+
+    explicit RenderWorker(QObject *parent = nullptr);
+
+    ~RenderWorker() override;
+
+    // returns generation of the job
+    quint64 post(Job job);
+
+    // drops waiting job and cancels the one being rendered
+    void cancel();
+
+    // generation of the newest job, results of older ones are stale
+    [[nodiscard]] quint64 generation() const;
+
+signals:
+
+    void rendered(const cv::Mat &image, quint64 generation);
+
+    // the newest job returned nothing without being cancelled
+    void failed(quint64 generation);
+
+private:
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    Job pending;
+    std::atomic<quint64> latest{0};
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif //PHOTOEDITOR_RENDERWORKER_H
@@ -0,0 +1,73 @@
+#ifndef PHOTOEDITOR_RESULTCACHE_H
+#define PHOTOEDITOR_RESULTCACHE_H
+
+#include "algorithms.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace image_algorithms {
+
+    /**
+     * Bounded LRU cache of command results
+     *
+     * Keyed by the content hash of the input and Command::key(),
+     * so the same edit of the same pixels is looked up instead of
+     * rendered again, no matter which Mat holds them.
+     * Cached results are shared and must not be written to
+     */
+    class ResultCache {
+    public:
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0;
+            size_t entries = 0;
+            size_t bytes = 0;
+        };
+
+        explicit ResultCache(size_t budget = size_t(256) << 20);
+
+        /**
+         * Key of command run on input, empty if the command can not be cached
+         */
+        static std::string key(const Command& command, const cv::Mat& input);
+
+        /**
+         * Sets result and seconds it took to compute if key is cached
+         */
+        bool find(const std::string& key, cv::Mat& result, double& seconds);
+
+        /**
+         * Stores result, least recently used results are evicted
+         * to stay within the budget. Results larger than it are not stored
+         */
+        void insert(const std::string& key, const cv::Mat& result, double seconds);
+
+        void clear();
+
+        [[nodiscard]] Stats stats() const;
+
+        // bytes of results kept at most, 0 disables the cache
+        [[nodiscard]] size_t budget() const;
+
+    private:
+        struct Entry {
+            std::string key;
+            cv::Mat result;
+            double seconds;
+        };
+
+        size_t max_bytes;
+
+        mutable std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        Stats counters;
+    };
+}
+
+#endif //PHOTOEDITOR_RESULTCACHE_H
@@ -0,0 +1,94 @@
+#ifndef PHOTOEDITOR_SPILL_H
+#define PHOTOEDITOR_SPILL_H
+
+#include "opencv2/opencv.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace image_algorithms {
+
+    class SpilledImage;
+
+    /**
+     * Scratch file images are paged out to
+     *
+     * Created in $XDG_CACHE_HOME/photoeditor (~/.cache/photoeditor
+     * if it is not set) and unlinked right away, so nothing is left
+     * behind even if the editor crashes. Space of released images
+     * is reused by the next ones
+     */
+    class SpillFile {
+    public:
+        SpillFile();
+
+        [[nodiscard]] bool is_open() const;
+
+        /**
+         * Writes image to the file,
+         * nullptr if the file is not open or full
+         */
+        std::shared_ptr<const SpilledImage> write(const cv::Mat& image);
+
+        // bytes of images stored in the file
+        [[nodiscard]] size_t bytes() const;
+
+        // directory spill files are created in
+        static std::string directory();
+
+    private:
+        friend class SpilledImage;
+
+        // outlives the file object while any of its images is alive
+        struct State {
+            int fd = -1;
+            mutable std::mutex mutex;
+            size_t end = 0;
+            size_t bytes = 0;
+            // length -> offset of released extents
+            std::multimap<size_t, size_t> free;
+
+            ~State();
+        };
+
+        std::shared_ptr<State> state;
+    };
+
+
+    /**
+     * Image paged out to a SpillFile, its space is released with it
+     */
+    class SpilledImage {
+    public:
+        ~SpilledImage();
+
+        SpilledImage(const SpilledImage&) = delete;
+
+        SpilledImage& operator=(const SpilledImage&) = delete;
+
+        /**
+         * Maps the image back and copies it into a new Mat
+         *
+         * Safe to call from any thread
+         */
+        [[nodiscard]] cv::Mat read() const;
+
+        [[nodiscard]] size_t bytes() const;
+
+    private:
+        friend class SpillFile;
+
+        SpilledImage(std::shared_ptr<SpillFile::State> file, size_t offset, size_t length,
+                     cv::Size size, int type);
+
+        std::shared_ptr<SpillFile::State> file;
+        size_t offset;
+        size_t length;
+        cv::Size size;
+        int type;
+    };
+}
+
+#endif //PHOTOEDITOR_SPILL_H
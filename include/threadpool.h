@@ -0,0 +1,67 @@
+#ifndef PHOTOEDITOR_THREADPOOL_H
+#define PHOTOEDITOR_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Work-stealing thread pool
+     *
+     * Every worker pops from the back of its own queue
+     * and steals from the front of the others when it runs dry
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * Runs task(i) for every i in [0, count) and waits for all of them
+         *
+         * Calling thread takes part in the work, so it is safe
+         * to call from inside of a task. If tasks throw, the first
+         * exception is rethrown once all of them are finished
+         */
+        void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+        [[nodiscard]] size_t size() const;
+
+        // shared pool with a worker per core
+        static ThreadPool& instance();
+
+    private:
+        using Task = std::function<void()>;
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool pop(size_t self, Task& task);
+
+        void work(size_t self);
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        std::atomic<size_t> pending{0};
+        bool stopping = false;
+    };
+}
+
+#endif //PHOTOEDITOR_THREADPOOL_H
@@ -0,0 +1,67 @@
+#ifndef PHOTOEDITOR_TILES_H
+#define PHOTOEDITOR_TILES_H
+
+#include "algorithms.h"
+#include "threadpool.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Size of L2 cache of this machine in bytes
+     */
+    size_t l2_cache_size();
+
+    /**
+     * Returns true when a render should stop
+     */
+    using Cancelled = std::function<bool()>;
+
+    /**
+     * Runs tileable commands tile by tile on a thread pool
+     *
+     * Whole chain is applied to one tile before going to the next one,
+     * so the tile stays in cache. Tiles are widened by the sum of halos
+     * of the chain and only their inner part is written to the result
+     *
+     * Cancellation is checked before every tile
+     */
+    class TileScheduler {
+    private:
+        size_t cache_bytes;
+        ThreadPool& pool;
+
+    public:
+        explicit TileScheduler(size_t cache_bytes = l2_cache_size(),
+                               ThreadPool& pool = ThreadPool::instance());
+
+        /**
+         * Side of a square tile that fits into cache
+         * together with its halo and intermediate results
+         */
+        [[nodiscard]] int tile_side(const cv::Mat& image, int halo) const;
+
+        /**
+         * Result of the chain in dst
+         *
+         * Runs of tileable commands are run in tiles, other commands
+         * on the whole image through execute_into(). dst is reused
+         * if it has the right size and type, in-place commands write
+         * over intermediate results instead of allocating new ones
+         *
+         * Returns false if cancelled, dst is undefined then
+         */
+        bool run(const std::vector<std::shared_ptr<const Command>>& chain, const cv::Mat& src, cv::Mat& dst,
+                 const Cancelled& cancelled = nullptr) const;
+
+        /**
+         * Tiled execution for tileable commands, plain execute() for the rest
+         */
+        cv::Mat execute(const Command& command, const cv::Mat& image) const;
+    };
+}
+
+#endif //PHOTOEDITOR_TILES_H
@@ -0,0 +1,126 @@
+#ifndef PHOTOEDITOR_TILESTORE_H
+#define PHOTOEDITOR_TILESTORE_H
+
+#include "opencv2/opencv.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * 64 bit hash of the pixels, size and type of image
+     */
+    uint64_t hash_pixels(const cv::Mat& pixels);
+
+    /**
+     * Same as hash_pixels, but bands of tiles are hashed in parallel.
+     * Values differ from hash_pixels of the same image
+     */
+    uint64_t hash_image(const cv::Mat& image);
+
+    /**
+     * Immutable block of pixels with the hash of its content
+     */
+    struct Tile {
+        uint64_t hash = 0;
+        cv::Mat pixels;
+    };
+
+    /**
+     * Intern table of tiles
+     *
+     * Tiles with equal content are stored once and shared,
+     * a tile is freed when the last image using it is gone
+     */
+    class TileStore {
+    public:
+        using TilePtr = std::shared_ptr<const Tile>;
+
+        TileStore();
+
+        /**
+         * Shared tile with the same content as pixels,
+         * pixels are copied only if there is none yet
+         *
+         * Safe to call from several threads
+         */
+        TilePtr intern(const cv::Mat& pixels);
+
+        // bytes of pixels of all stored tiles
+        [[nodiscard]] size_t bytes() const;
+
+        // number of stored tiles
+        [[nodiscard]] size_t size() const;
+
+    private:
+        // outlives the store while any of its tiles is alive
+        struct State {
+            mutable std::mutex mutex;
+            std::unordered_multimap<uint64_t, std::weak_ptr<const Tile>> tiles;
+            size_t bytes = 0;
+        };
+
+        std::shared_ptr<State> state;
+    };
+
+
+    /**
+     * Image split into square tiles of a TileStore
+     *
+     * Copies of a TiledImage and images made from the same
+     * pixels share their tiles, so only changed tiles take memory.
+     * The grid of a view (e.g. a crop) is aligned to the Mat it is
+     * part of, so its tiles are the ones of that image.
+     * Views of the image are made on demand and must not be written to
+     */
+    class TiledImage {
+    public:
+        static constexpr int tile_side = 256;
+
+        TiledImage() = default;
+
+        TiledImage(const cv::Mat& image, TileStore& store);
+
+        [[nodiscard]] bool empty() const;
+
+        [[nodiscard]] cv::Size size() const;
+
+        [[nodiscard]] int type() const;
+
+        // number of tiles in a row and a column
+        [[nodiscard]] cv::Size grid() const;
+
+        // position of the first pixel in the first tile
+        [[nodiscard]] cv::Point origin() const;
+
+        // view of one tile, no copy
+        [[nodiscard]] cv::Mat tile(int row, int col) const;
+
+        /**
+         * Part of the image
+         *
+         * A view if rect lies inside of one tile, a copy otherwise
+         */
+        [[nodiscard]] cv::Mat region(const cv::Rect& rect) const;
+
+        /**
+         * Whole image as a copy, placed at origin()
+         * of its buffer, so it is continuous only if that is (0, 0)
+         */
+        [[nodiscard]] cv::Mat mat() const;
+
+    private:
+        cv::Size image_size;
+        int image_type = 0;
+        cv::Size tiles_grid;
+        cv::Point grid_origin;
+        std::vector<TileStore::TilePtr> tiles;
+
+        [[nodiscard]] cv::Rect tile_rect(int row, int col) const;
+    };
+}
+
+#endif //PHOTOEDITOR_TILESTORE_H
@@ -0,0 +1,22 @@
+#ifndef PHOTOEDITOR_UNSHARP_H
+#define PHOTOEDITOR_UNSHARP_H
+
+#include "opencv2/opencv.hpp"
+
+namespace image_algorithms {
+
+    /**
+     * Unsharp mask: image + amount * (image - gaussian blur of image)
+     *
+     * Blur and combination are done in one sweep over stripes of rows,
+     * the blurred image is never stored. Pixels that differ from
+     * their blur by no more than threshold (in levels of the image)
+     * are left as they are. With luminance only the brightness is
+     * blurred and its detail added to every channel, which is a third
+     * of the work on color images and keeps colors from fringing
+     */
+    cv::Mat unsharp_mask(const cv::Mat& image, double amount, double sigma, double threshold = 0,
+                         bool luminance = false);
+}
+
+#endif //PHOTOEDITOR_UNSHARP_H
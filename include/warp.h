@@ -0,0 +1,53 @@
+#ifndef PHOTOEDITOR_WARP_H
+#define PHOTOEDITOR_WARP_H
+
+#include "algorithms.h"
+
+#include <memory>
+#include <vector>
+
+namespace image_algorithms {
+
+    /**
+     * Resamples image into a result of the given size, transform maps
+     * pixel coordinates of the image to the ones of the result
+     *
+     * Integer shifts are returned as views of image, quarter turns
+     * and flips are done by cv::rotate and cv::flip without resampling.
+     * Other transforms are warped in bands on the thread pool,
+     * pixels outside of the result are never computed
+     */
+    cv::Mat apply_warp(const cv::Mat& image, const cv::Matx33d& transform, cv::Size size);
+
+    /**
+     * True if apply_warp does warp command on an image of given
+     * size without resampling, e.g. a crop or a quarter turn
+     */
+    bool moves_pixels(const Command& command, cv::Size input);
+
+    /**
+     * Consecutive warps (Crop, RotateInFrame, TransformPerspective)
+     * composed into one transform
+     *
+     * The image is resampled once, only where the last
+     * command keeps it, so blur does not add up
+     */
+    class Warp : public Command {
+    private:
+        std::vector<std::shared_ptr<const Command>> commands;
+
+    public:
+        explicit Warp(std::vector<std::shared_ptr<const Command>> commands);
+
+        cv::Mat execute(const cv::Mat& image) const override;
+
+        bool is_warp() const override;
+
+        void warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const override;
+
+        // keys of the commands, empty if one of them has none
+        std::string key() const override;
+    };
+}
+
+#endif //PHOTOEDITOR_WARP_H
@@ -0,0 +1,52 @@
+#ifndef PHOTOEDITOR_ZOOMANIMATOR_H
+#define PHOTOEDITOR_ZOOMANIMATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+/**
+ * Smooth zoom towards a target scale
+ *
+ * Wheel steps arriving during the animation move the target and
+ * restart the easing from where the scale is, so there is always one
+ * animation however fast the wheel turns. Scale is computed from the
+ * time passed, one step per display frame, and the last frame is
+ * reported as settled
+ */
+class ZoomAnimator : public QObject {
+Q_OBJECT
+
+public:
+    explicit ZoomAnimator(QObject *parent = nullptr);
+
+    // multiplies the target, starting from scale if nothing is animated
+    void zoomBy(double factor, double scale);
+
+    void stop();
+
+    [[nodiscard]] bool isActive() const;
+
+signals:
+
+    // settled -- the last frame of the animation, scale equals the target
+    void zoomed(double scale, bool settled);
+
+private:
+    void step();
+
+    // scales an animation never leaves
+    static constexpr double minScale = 0.01;
+    static constexpr double maxScale = 10;
+    static const int durationMs = 250;
+    static const int frameMs = 16;
+
+    QTimer timer;
+    // time since the target last changed
+    QElapsedTimer clock;
+    double start = 1;
+    double current = 1;
+    double target = 1;
+};
+
+#endif //PHOTOEDITOR_ZOOMANIMATOR_H
@@ -3,6 +3,14 @@
 //
 
 #include "../include/algorithms.h"
+#include "../include/iirblur.h"
+#include "../include/pipeline.h"
+#include "../include/tilestore.h"
+#include "../include/unsharp.h"
+#include "../include/warp.h"
+
+#include <algorithm>
+#include <set>
 
 namespace image_algorithms {
     using namespace cv;
@@ -23,40 +31,209 @@ namespace image_algorithms {
     }
 
     cv::Mat crop(const cv::Mat& image, int w, int h, int x, int y) {
+        // an empty result could not be told from a failed render
+        CV_Assert(w > 0 && h > 0);
         return image(cv::Rect(x, y, w, h));
     }
 
+    double value_range(int depth) {
+        switch (depth) {
+            case CV_8U:
+                return 255;
+            case CV_16U:
+                return 65535;
+            case CV_16S:
+                return 32767;
+            default:
+                return 1;
+        }
+    }
+
+    namespace {
+
+        // parameters of commands are given for 8-bit images
+        double in_range(double value, int depth) {
+            return value * value_range(depth) / 255;
+        }
+
+        // image with the channels and depth of type, values rescaled to its range
+        cv::Mat converted(const cv::Mat& image, int type) {
+            if (image.type() == type) {
+                return image;
+            }
+
+            cv::Mat res = image;
+            const int from = image.channels(), to = CV_MAT_CN(type);
+            if (from != to) {
+                static const int codes[5][5] = {
+                        {},
+                        {0, 0, 0, cv::COLOR_GRAY2BGR,  cv::COLOR_GRAY2BGRA},
+                        {},
+                        {0, cv::COLOR_BGR2GRAY,  0, 0, cv::COLOR_BGR2BGRA},
+                        {0, cv::COLOR_BGRA2GRAY, 0, cv::COLOR_BGRA2BGR,  0},
+                };
+                CV_Assert((from == 1 || from == 3 || from == 4) && (to == 1 || to == 3 || to == 4));
+                cvtColor(image, res, codes[from][to]);
+            }
+
+            const int depth = CV_MAT_DEPTH(type);
+            if (res.depth() != depth) {
+                res.convertTo(res, depth, value_range(depth) / value_range(res.depth()));
+            }
+            return res;
+        }
+
+        // gray images as BGR, so color can be added to them
+        cv::Mat as_color(const cv::Mat& image) {
+            return image.channels() == 1 ? converted(image, CV_MAKETYPE(image.depth(), 3)) : image;
+        }
+
+        cv::Mat to_unit_float(const cv::Mat& image) {
+            cv::Mat res;
+            image.convertTo(res, CV_32F, 1 / value_range(image.depth()));
+            return res;
+        }
+
+        cv::Mat from_unit_float(const cv::Mat& image, int depth) {
+            cv::Mat res;
+            image.convertTo(res, depth, value_range(depth));
+            return res;
+        }
+
+        inline float clamp(float v, float low, float high) {
+            return std::min(std::max(v, low), high);
+        }
+    }
+
+    cv::Mat read_image(const std::string& path) {
+        return cv::imread(path, cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+    }
+
+    cv::Mat read_image_reduced(const std::string& path, int factor) {
+        switch (factor) {
+            case 2:
+                return cv::imread(path, cv::IMREAD_REDUCED_COLOR_2);
+            case 4:
+                return cv::imread(path, cv::IMREAD_REDUCED_COLOR_4);
+            case 8:
+                return cv::imread(path, cv::IMREAD_REDUCED_COLOR_8);
+            default:
+                CV_Error(cv::Error::StsBadArg, "can not reduce image by " + std::to_string(factor));
+        }
+    }
+
+    bool write_image(const std::string& path, const cv::Mat& image) {
+        std::string ext = path.substr(path.rfind('.') + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        // formats that hold more than 8 bits per channel
+        static const std::set<std::string> deep = {"png", "tif", "tiff", "pgm", "ppm", "pnm", "pxm", "jp2"};
+
+        if (image.depth() == CV_8U || (image.depth() == CV_16U && deep.count(ext))) {
+            return cv::imwrite(path, image);
+        }
+        return cv::imwrite(path, converted(image, CV_MAKETYPE(CV_8U, image.channels())));
+    }
+
     cv::Mat gray(const cv::Mat& image) {
+        if (image.channels() == 1) {
+            return image;
+        }
+
         cv::Mat bw;
 
-        // black & white filter
-        cvtColor(image, bw, cv::COLOR_BGR2GRAY);
-        cvtColor(bw, bw, cv::COLOR_GRAY2BGR);
+        // black & white filter, a single channel holds all of it
+        cvtColor(image, bw, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
 
         return bw;
     }
 
-    cv::Mat rotate_in_frame(const cv::Mat& image, double angle) {
+    namespace {
+
+        // rotation of an image of the given size, frame is set to the size that holds all of it
+        cv::Mat rotation_in_frame(cv::Size size, double angle, cv::Size& frame) {
 
-        // get rotation matrix for rotating the image around its center in pixel coordinates
-        cv::Point2f center((image.cols - 1) / 2.0, (image.rows - 1) / 2.0);
-        cv::Mat rot = cv::getRotationMatrix2D(center, angle, 1.0);
+            // get rotation matrix for rotating the image around its center in pixel coordinates
+            cv::Point2f center((size.width - 1) / 2.0, (size.height - 1) / 2.0);
+            cv::Mat rot = cv::getRotationMatrix2D(center, angle, 1.0);
 
-        // determine bounding rectangle, center not relevant
-        cv::Rect2f bbox = cv::RotatedRect(cv::Point2f(), image.size(), angle).boundingRect2f();
+            // determine bounding rectangle, center not relevant
+            cv::Rect2f bbox = cv::RotatedRect(cv::Point2f(), size, angle).boundingRect2f();
 
-        // adjust transformation matrix
-        rot.at<double>(0, 2) += bbox.width / 2.0 - image.cols / 2.0;
-        rot.at<double>(1, 2) += bbox.height / 2.0 - image.rows / 2.0;
+            // adjust transformation matrix
+            rot.at<double>(0, 2) += bbox.width / 2.0 - size.width / 2.0;
+            rot.at<double>(1, 2) += bbox.height / 2.0 - size.height / 2.0;
+
+            frame = bbox.size();
+            return rot;
+        }
+
+        // 2x3 affine matrix as 3x3
+        cv::Matx33d homogeneous(const cv::Mat& affine) {
+            cv::Matx33d res = cv::Matx33d::eye();
+            for (int i = 0; i < 2; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    res(i, j) = affine.at<double>(i, j);
+                }
+            }
+            return res;
+        }
+
+        // maps corners of an image of the given size to outputQuad
+        cv::Mat perspective(cv::Size size, const cv::Point2f outputQuad[4]) {
+            // The 4 points that select quadilateral on the input , from top-left in clockwise order
+            // These four pts are the sides of the rect box used as input
+            cv::Point2f inputQuad[4] = {
+                    cv::Point2f(0, 0),
+                    cv::Point2f(size.width, 0),
+                    cv::Point2f(size.width, size.height),
+                    cv::Point2f(0, size.height)
+            };
+
+            return getPerspectiveTransform(inputQuad, outputQuad);
+        }
+    }
+
+    cv::Mat rotate_in_frame(const cv::Mat& image, double angle) {
+        cv::Size frame;
+        cv::Mat rot = rotation_in_frame(image.size(), angle, frame);
 
         cv::Mat dst;
-        cv::warpAffine(image, dst, rot, bbox.size());
+        cv::warpAffine(image, dst, rot, frame);
 
         return dst;
     }
 
     cv::Mat hsv_add_scalar(const cv::Mat& image, int h, int s, int v) {
 
+        if (image.channels() == 1) {
+            cv::Mat res = hsv_add_scalar(as_color(image), h, s, v);
+
+            // without saturation hue does not matter, gray stays gray
+            if (s == 0) {
+                cvtColor(res, res, COLOR_BGR2GRAY);
+            }
+            return res;
+        }
+
+        if (image.depth() != CV_8U) {
+            cv::Mat hsv;
+            cvtColor(to_unit_float(image), hsv, COLOR_BGR2HSV);
+
+            // float HSV has hue in degrees, saturation and value in [0, 1]
+            const float dh = 2.f * h, ds = s / 255.f, dv = v / 255.f;
+            auto* p = hsv.ptr<float>();
+            for (size_t i = 0; i < hsv.total(); ++i) {
+                float hue = std::fmod(p[3 * i] + dh, 360.f);
+                p[3 * i] = hue < 0 ? hue + 360.f : hue;
+                p[3 * i + 1] = clamp(p[3 * i + 1] + ds, 0.f, 1.f);
+                p[3 * i + 2] = clamp(p[3 * i + 2] + dv, 0.f, 1.f);
+            }
+
+            cvtColor(hsv, hsv, COLOR_HSV2BGR);
+            return from_unit_float(hsv, image.depth());
+        }
+
         cv::Mat res;
 
         // convert to hsv
@@ -71,12 +248,27 @@ namespace image_algorithms {
         return res;
     }
 
-    // value in [-100, 100]
+    // weight of the original image, value in [-100, 100]
+    double saturation_alpha(int value) {
+        return (value + 100) / 100.0;
+    }
+
     cv::Mat saturate(const cv::Mat& image, int value) {
-        value += 100;
-        double alpha = value / 100.0;
-        cv::Mat tmp, res;
-        addWeighted(image, alpha, gray(image), 1 - alpha, 0.0, res);
+
+        // nothing to saturate
+        if (image.channels() == 1) {
+            return image;
+        }
+
+        double alpha = saturation_alpha(value);
+        cv::Mat res;
+        addWeighted(image, alpha, converted(gray(image), image.type()), 1 - alpha, 0.0, res);
+
+        // alpha of the image is not a color
+        if (image.channels() == 4) {
+            int from_to[] = {3, 3};
+            cv::mixChannels(&image, 1, &res, 1, from_to, 1);
+        }
         return res;
     }
 
@@ -94,17 +286,21 @@ namespace image_algorithms {
     }
 
 
+    double contrast_factor(int value) {
+        return (double) (259 * (value + 255)) / (255 * (259 - value));
+    }
+
     cv::Mat contrast(const cv::Mat& image, int value) {
 
         cv::Mat res;
 
         // get factor
-        double factor = (double) (259 * (value + 255)) / (255 * (259 - value));
+        double factor = contrast_factor(value);
 
         // linear transformation
         // what it does here is basically:
         // C' = (C - 128) * (factor) + 128
-        image.convertTo(res, CV_8UC1, (factor), 128 * (1 - factor));
+        image.convertTo(res, -1, (factor), in_range(128, image.depth()) * (1 - factor));
 
         return res;
     }
@@ -120,6 +316,33 @@ namespace image_algorithms {
 
     cv::Mat lab_add_scalar(const cv::Mat& image, int l, int a, int b) {
 
+        if (image.channels() == 1) {
+            cv::Mat res = lab_add_scalar(as_color(image), l, a, b);
+
+            // lightness alone keeps gray gray
+            if (a == 0 && b == 0) {
+                cvtColor(res, res, cv::COLOR_BGR2GRAY);
+            }
+            return res;
+        }
+
+        if (image.depth() != CV_8U) {
+            cv::Mat lab;
+            cvtColor(to_unit_float(image), lab, cv::COLOR_BGR2Lab);
+
+            // float Lab has L in [0, 100] instead of [0, 255], a and b are not offset by 128
+            const float dl = l * 100.f / 255;
+            auto* p = lab.ptr<float>();
+            for (size_t i = 0; i < lab.total(); ++i) {
+                p[3 * i] = clamp(p[3 * i] + dl, 0.f, 100.f);
+                p[3 * i + 1] += a;
+                p[3 * i + 2] += b;
+            }
+
+            cvtColor(lab, lab, cv::COLOR_Lab2BGR);
+            return from_unit_float(lab, image.depth());
+        }
+
         cv::Mat res;
 
         // convert to Lab
@@ -135,16 +358,25 @@ namespace image_algorithms {
     }
 
 
-    cv::Mat blend(const cv::Mat& img1, const cv::Mat& img2, double alpha) {
+    void blend(const cv::Mat& image_1, const cv::Mat& image_2, double alpha, cv::Mat& dst) {
+
+        // result has the depth of the first image and the channels of the more colorful one
+        const int type = CV_MAKETYPE(image_1.depth(), std::max(image_1.channels(), image_2.channels()));
+        cv::Mat img1 = converted(image_1, type), img2 = converted(image_2, type);
 
         // get beta
         double beta = (1.0 - alpha);
 
-        cv::Mat dst;
+        // images of different sizes are blended on their common top left part
+        cv::Rect roi(0, 0, std::min(img1.cols, img2.cols), std::min(img1.rows, img2.rows));
 
         // sum of images
-        addWeighted(img1, alpha, img2, beta, 0.0, dst);
+        addWeighted(img1(roi), alpha, img2(roi), beta, 0.0, dst);
+    }
 
+    cv::Mat blend(const cv::Mat& img1, const cv::Mat& img2, double alpha) {
+        cv::Mat dst;
+        blend(img1, img2, alpha, dst);
         return dst;
     }
 
@@ -152,17 +384,23 @@ namespace image_algorithms {
     cv::Mat tint(const cv::Mat& image, int value) {
 
         // + green
-        return image + Scalar(0, value, 0);
+        return as_color(image) + Scalar(0, in_range(value, image.depth()), 0);
     }
 
 
     cv::Mat temperature(const cv::Mat& image, int value) {
 
         // - blue + red
-        return image + Scalar(-value, 0, value);
+        double shift = in_range(value, image.depth());
+        return as_color(image) + Scalar(-shift, 0, shift);
     }
 
 
+    // radius of kernel picked by GaussianBlur for a given sigma (4 sigma for float images)
+    int gaussian_radius(double sigma) {
+        return (cvRound(sigma * 4 * 2 + 1) | 1) / 2;
+    }
+
     cv::Mat blur(const cv::Mat& image, double value) {
 
         cv::Mat res;
@@ -173,51 +411,137 @@ namespace image_algorithms {
         return res;
     }
 
-    cv::Mat sharpen(const cv::Mat& image, double value) {
 
-        // get default blur of the image
-        cv::Mat res = blur(image, 3);
+    cv::Mat transform_perspective(const cv::Mat& input, const cv::Point2f outputQuad[4]) {
 
-        // just subtract blur image with given factor
-        cv::addWeighted(image, 1 + value, res, -value, 0, res);
+        cv::Mat res;
+
+        // Get the Perspective Transform Matrix i.e. lambda
+        cv::Mat lambda = perspective(input.size(), outputQuad);
+
+        // Apply the Perspective Transform just found to the src image
+        warpPerspective(input, res, lambda, input.size());
 
         return res;
     }
 
+    void apply_color(const cv::Mat& image, int r, int g, int b, double alpha, cv::Mat& dst) {
+        cv::Mat mat = as_color(image);
+        const int cn = mat.channels();
+        CV_Assert(cn == 3 || cn == 4);
+        const double color[3] = {(double) b, (double) g, (double) r};
+
+        if (mat.depth() != CV_8U || cn != 3) {
+            // one affine pass of any depth, alpha is kept
+            cv::Mat m = cv::Mat::zeros(cn, cn + 1, CV_64F);
+            for (int c = 0; c < 3; ++c) {
+                m.at<double>(c, c) = 1 - alpha;
+                m.at<double>(c, cn) = in_range(color[c], mat.depth()) * alpha;
+            }
+            if (cn == 4) {
+                m.at<double>(3, 3) = 1;
+            }
+
+            cv::transform(mat, dst, m);
+            return;
+        }
+
+        // table of every channel, interleaved as the pixels are
+        uchar table[256 * 3];
+        for (int i = 0; i < 256; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                table[i * 3 + c] = saturate_cast<uchar>(i * (1 - alpha) + color[c] * alpha);
+            }
+        }
+
+        cv::LUT(mat, cv::Mat(1, 256, CV_8UC3, table), dst);
+    }
+
+    cv::Mat apply_color(const cv::Mat& mat, int r, int g, int b, double alpha) {
+        cv::Mat dst;
+        apply_color(mat, r, g, b, alpha, dst);
+        return dst;
+    }
 
-    cv::Mat transform_perspective(const cv::Mat& input, cv::Point2f outputQuad[4]) {
 
-        cv::Mat res;
+    namespace {
 
-        // Input Quadilateral or Image plane coordinates
-        Point2f inputQuad[4];
+        // point ops of the types the fused kernel is specialized for go through it
+        bool run_point_kernel(const Command& command, const cv::Mat& image, cv::Mat& dst) {
+            PointOp op;
+            if (!has_point_kernel(image.type()) || !command.point_op(op)) {
+                return false;
+            }
 
-        // Lambda Matrix
-        Mat lambda(2, 4, CV_32FC1);
+            apply_point_ops({op}, image, dst);
+            return true;
+        }
+    }
 
 
-        // Set the lambda matrix the same type and size as input
-        lambda = Mat::zeros(input.rows, input.cols, input.type());
+    void Command::execute_into(const cv::Mat& image, cv::Mat& dst) const {
+        if (!run_point_kernel(*this, image, dst)) {
+            dst = execute(image);
+        }
+    }
 
-        // The 4 points that select quadilateral on the input , from top-left in clockwise order
-        // These four pts are the sides of the rect box used as input
-        inputQuad[0] = Point2f(0, 0);
-        inputQuad[1] = Point2f(input.cols, 0);
-        inputQuad[2] = Point2f(input.cols, input.rows);
-        inputQuad[3] = Point2f(0, input.rows);
+    bool Command::in_place() const {
+        PointOp op;
+        return point_op(op);
+    }
 
-        // Get the Perspective Transform Matrix i.e. lambda
-        lambda = getPerspectiveTransform(inputQuad, outputQuad);
+    bool Command::point_op(PointOp&) const {
+        return false;
+    }
 
-        // Apply the Perspective Transform just found to the src image
-        warpPerspective(input, res, lambda, res.size());
+    bool Command::is_color_op() const {
+        PointOp op;
+        return point_op(op);
+    }
 
-        return res;
+    void Command::apply_to_colors(cv::Mat& colors) const {
+        PointOp op;
+        CV_Assert(point_op(op));
+        apply_point_op(op, colors);
     }
 
-    cv::Mat apply_color(const cv::Mat& mat, int r, int g, int b, double alpha) {
-        cv::Mat m(mat.rows, mat.cols, CV_8UC3, cv::Scalar(b, g, r));
-        return blend(mat, m, 1 - alpha);
+    bool Command::is_warp() const {
+        return false;
+    }
+
+    void Command::warp(cv::Size, cv::Matx33d&, cv::Size&) const {
+        CV_Error(cv::Error::StsNotImplemented, "not a warp");
+    }
+
+    bool Command::is_tileable() const {
+        return is_color_op();
+    }
+
+    int Command::halo() const {
+        return 0;
+    }
+
+    std::shared_ptr<const Command> Command::scaled(double) const {
+        return nullptr;
+    }
+
+    std::string Command::name() const {
+        return "";
+    }
+
+    void Command::write(cv::FileStorage&) const {
+    }
+
+    std::string Command::key() const {
+        if (name().empty()) {
+            return "";
+        }
+
+        cv::FileStorage fs(std::string(), cv::FileStorage::WRITE | cv::FileStorage::MEMORY |
+                                          cv::FileStorage::FORMAT_YAML);
+        fs << "name" << name();
+        write(fs);
+        return fs.releaseAndGetString();
     }
 
 
@@ -228,18 +552,110 @@ namespace image_algorithms {
         return crop(image, w, h, x, y);
     }
 
+    bool Crop::is_warp() const {
+        return true;
+    }
+
+    void Crop::warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const {
+        CV_Assert(w > 0 && h > 0 && x >= 0 && y >= 0 && x + w <= input.width && y + h <= input.height);
+        transform = cv::Matx33d(1, 0, -x,
+                                0, 1, -y,
+                                0, 0, 1);
+        output = cv::Size(w, h);
+    }
+
+    std::string Crop::name() const {
+        return "crop";
+    }
+
+    void Crop::write(cv::FileStorage& fs) const {
+        fs << "width" << w;
+        fs << "height" << h;
+        fs << "x" << x;
+        fs << "y" << y;
+    }
+
+    std::shared_ptr<const Command> Crop::read(const cv::FileNode& node) {
+        return std::make_shared<Crop>((int) node["width"], (int) node["height"], (int) node["x"], (int) node["y"]);
+    }
+
+    std::shared_ptr<const Command> Crop::scaled(double scale) const {
+        // round the far corner down, so it stays inside of the downscaled image,
+        // and keep a pixel at least
+        int x1 = std::max(cvFloor((x + w) * scale), 1), y1 = std::max(cvFloor((y + h) * scale), 1);
+        int x0 = std::min(cvRound(x * scale), x1 - 1), y0 = std::min(cvRound(y * scale), y1 - 1);
+        return std::make_shared<Crop>(x1 - x0, y1 - y0, x0, y0);
+    }
+
 
     RotateInFrame::RotateInFrame(double angle) : angle{angle} {}
 
     cv::Mat RotateInFrame::execute(const cv::Mat& base_image) const {
-        return rotate_in_frame(base_image, angle);
+        // quarter turns are done without resampling
+        cv::Matx33d transform;
+        cv::Size size;
+        warp(base_image.size(), transform, size);
+        return apply_warp(base_image, transform, size);
+    }
+
+    bool RotateInFrame::is_warp() const {
+        return true;
+    }
+
+    void RotateInFrame::warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const {
+        transform = homogeneous(rotation_in_frame(input, angle, output));
+    }
+
+    std::string RotateInFrame::name() const {
+        return "rotate";
+    }
+
+    void RotateInFrame::write(cv::FileStorage& fs) const {
+        fs << "angle" << angle;
+    }
+
+    std::shared_ptr<const Command> RotateInFrame::read(const cv::FileNode& node) {
+        return std::make_shared<RotateInFrame>((double) node["angle"]);
     }
 
     Saturate::Saturate(int value) : value{value} {
     }
 
     cv::Mat Saturate::execute(const cv::Mat& image) const {
-        return saturate(image, value);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = saturate(image, value);
+        }
+        return res;
+    }
+
+    std::string Saturate::name() const {
+        return "saturate";
+    }
+
+    void Saturate::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Saturate::read(const cv::FileNode& node) {
+        return std::make_shared<Saturate>((int) node["value"]);
+    }
+
+    bool Saturate::point_op(PointOp& op) const {
+        float alpha = saturation_alpha(value);
+
+        // alpha * image + (1 - alpha) * gray(image),
+        // gray weights are the ones used by BGR2GRAY
+        cv::Matx34f m;
+        for (int i = 0; i < 3; ++i) {
+            m(i, 0) = (1 - alpha) * 0.114f;
+            m(i, 1) = (1 - alpha) * 0.587f;
+            m(i, 2) = (1 - alpha) * 0.299f;
+            m(i, i) += alpha;
+        }
+
+        op = PointOp::affine(m);
+        return true;
     }
 
 
@@ -247,7 +663,28 @@ namespace image_algorithms {
     }
 
     cv::Mat Brighten::execute(const Mat& image) const {
-        return brighten(image, value);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = brighten(image, value);
+        }
+        return res;
+    }
+
+    std::string Brighten::name() const {
+        return "brighten";
+    }
+
+    void Brighten::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Brighten::read(const cv::FileNode& node) {
+        return std::make_shared<Brighten>((int) node["value"]);
+    }
+
+    bool Brighten::point_op(PointOp& op) const {
+        op = PointOp::value(value);
+        return true;
     }
 
     Lighten::Lighten(int value) : value{value} {
@@ -257,6 +694,37 @@ namespace image_algorithms {
         return lighten(image, value);
     }
 
+    std::string Lighten::name() const {
+        return "lighten";
+    }
+
+    void Lighten::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Lighten::read(const cv::FileNode& node) {
+        return std::make_shared<Lighten>((int) node["value"]);
+    }
+
+    bool Lighten::is_color_op() const {
+        return true;
+    }
+
+    void Lighten::apply_to_colors(cv::Mat& colors) const {
+        cv::Mat lab;
+
+        // float Lab has L in [0, 100] instead of [0, 255]
+        cvtColor(colors, lab, cv::COLOR_BGR2Lab);
+        float shift = value * 100.f / 255;
+
+        auto* p = lab.ptr<float>();
+        for (size_t i = 0; i < lab.total(); ++i) {
+            p[3 * i] = std::min(std::max(p[3 * i] + shift, 0.f), 100.f);
+        }
+
+        cvtColor(lab, colors, cv::COLOR_Lab2BGR);
+    }
+
     Hue::Hue(int value) : value{value} {
     }
 
@@ -264,16 +732,101 @@ namespace image_algorithms {
         return hue(image, value);
     }
 
+    std::string Hue::name() const {
+        return "hue";
+    }
+
+    void Hue::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Hue::read(const cv::FileNode& node) {
+        return std::make_shared<Hue>((int) node["value"]);
+    }
+
+    bool Hue::is_color_op() const {
+        return true;
+    }
+
+    void Hue::apply_to_colors(cv::Mat& colors) const {
+        cv::Mat hsv;
+
+        // float HSV has hue in degrees, 8-bit one in halves of degree
+        cvtColor(colors, hsv, COLOR_BGR2HSV);
+        float shift = 2.f * value;
+
+        // wrap hue around instead of saturating it
+        auto* p = hsv.ptr<float>();
+        for (size_t i = 0; i < hsv.total(); ++i) {
+            float h = std::fmod(p[3 * i] + shift, 360.f);
+            p[3 * i] = h < 0 ? h + 360.f : h;
+        }
+
+        cvtColor(hsv, colors, COLOR_HSV2BGR);
+    }
+
 
     Contrast::Contrast(int value) : value{value} {
     }
 
     cv::Mat Contrast::execute(const Mat& image) const {
-        return contrast(image, value);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = contrast(image, value);
+        }
+        return res;
+    }
+
+    std::string Contrast::name() const {
+        return "contrast";
+    }
+
+    void Contrast::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Contrast::read(const cv::FileNode& node) {
+        return std::make_shared<Contrast>((int) node["value"]);
+    }
+
+    bool Contrast::point_op(PointOp& op) const {
+        float factor = contrast_factor(value);
+        float shift = 128 * (1 - factor);
+
+        op = PointOp::affine(cv::Matx34f(factor, 0, 0, shift,
+                                         0, factor, 0, shift,
+                                         0, 0, factor, shift));
+        return true;
     }
 
     cv::Mat Gray::execute(const Mat& image) const {
-        return gray(image);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = gray(image);
+        }
+        return res;
+    }
+
+    bool Gray::point_op(PointOp& op) const {
+        // every channel gets the luma of BGR2GRAY
+        cv::Matx34f m;
+        for (int i = 0; i < 3; ++i) {
+            m(i, 0) = 0.114f;
+            m(i, 1) = 0.587f;
+            m(i, 2) = 0.299f;
+            m(i, 3) = 0;
+        }
+
+        op = PointOp::affine(m);
+        return true;
+    }
+
+    std::string Gray::name() const {
+        return "gray";
+    }
+
+    std::shared_ptr<const Command> Gray::read(const cv::FileNode& node) {
+        return std::make_shared<Gray>();
     }
 
     Blend::Blend(const Mat& image_2, double alpha) : image_2{image_2}, value{alpha} {
@@ -283,12 +836,59 @@ namespace image_algorithms {
         return blend(image_1, image_2, value);
     }
 
+    void Blend::execute_into(const Mat& image_1, Mat& dst) const {
+        blend(image_1, image_2, value, dst);
+    }
+
+    std::string Blend::name() const {
+        return "blend";
+    }
+
+    void Blend::write(cv::FileStorage& fs) const {
+        fs << "image" << image_2;
+        fs << "alpha" << value;
+    }
+
+    std::string Blend::key() const {
+        // hash instead of the pixels, writing them out costs more than blending
+        return name() + " " + std::to_string(hash_image(image_2)) + " " + std::to_string(value);
+    }
+
+    std::shared_ptr<const Command> Blend::read(const cv::FileNode& node) {
+        cv::Mat image;
+        node["image"] >> image;
+        return std::make_shared<Blend>(image, (double) node["alpha"]);
+    }
+
 
     Tint::Tint(int value) : value{value} {
     }
 
     cv::Mat Tint::execute(const Mat& image) const {
-        return tint(image, value);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = tint(image, value);
+        }
+        return res;
+    }
+
+    std::string Tint::name() const {
+        return "tint";
+    }
+
+    void Tint::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Tint::read(const cv::FileNode& node) {
+        return std::make_shared<Tint>((int) node["value"]);
+    }
+
+    bool Tint::point_op(PointOp& op) const {
+        op = PointOp::affine(cv::Matx34f(1, 0, 0, 0,
+                                         0, 1, 0, value,
+                                         0, 0, 1, 0));
+        return true;
     }
 
 
@@ -296,22 +896,111 @@ namespace image_algorithms {
     }
 
     cv::Mat Temperature::execute(const Mat& image) const {
-        return temperature(image, value);
+        cv::Mat res;
+        if (!run_point_kernel(*this, image, res)) {
+            res = temperature(image, value);
+        }
+        return res;
     }
 
+    std::string Temperature::name() const {
+        return "temperature";
+    }
+
+    void Temperature::write(cv::FileStorage& fs) const {
+        fs << "value" << value;
+    }
+
+    std::shared_ptr<const Command> Temperature::read(const cv::FileNode& node) {
+        return std::make_shared<Temperature>((int) node["value"]);
+    }
+
+    bool Temperature::point_op(PointOp& op) const {
+        op = PointOp::affine(cv::Matx34f(1, 0, 0, -value,
+                                         0, 1, 0, 0,
+                                         0, 0, 1, value));
+        return true;
+    }
+
+
+    Blur::Blur(double value, Method method) : value{value}, method{method} {
+    }
 
-    Blur::Blur(double value) : value{value} {
+    bool Blur::recursive() const {
+        // the recursive filter is defined from sigma 0.5 on
+        return value >= 0.5 && (method == Method::Recursive ||
+                                (method == Method::Auto && value >= recursive_threshold));
     }
 
     cv::Mat Blur::execute(const Mat& image) const {
-        return blur(image, value);
+        return recursive() ? recursive_blur(image, value) : blur(image, value);
     }
 
-    Sharpen::Sharpen(double value) : value{value} {
+    std::string Blur::name() const {
+        return "blur";
+    }
+
+    void Blur::write(cv::FileStorage& fs) const {
+        fs << "sigma" << value;
+        if (method != Method::Auto) {
+            fs << "method" << (method == Method::Exact ? "exact" : "recursive");
+        }
+    }
+
+    std::shared_ptr<const Command> Blur::read(const cv::FileNode& node) {
+        std::string method = (std::string) node["method"];
+        return std::make_shared<Blur>((double) node["sigma"],
+                                      method == "exact" ? Method::Exact :
+                                      method == "recursive" ? Method::Recursive : Method::Auto);
+    }
+
+    bool Blur::is_tileable() const {
+        // a recursive filter sees the whole column, its halo would be most of a tile
+        return !recursive();
+    }
+
+    int Blur::halo() const {
+        return gaussian_radius(value);
+    }
+
+    std::shared_ptr<const Command> Blur::scaled(double scale) const {
+        return std::make_shared<Blur>(value * scale, method);
+    }
+
+    Sharpen::Sharpen(double value, double sigma, double threshold, bool luminance)
+            : value{value}, sigma{sigma}, threshold{threshold}, luminance{luminance} {
     }
 
     cv::Mat Sharpen::execute(const Mat& image) const {
-        return sharpen(image, value);
+        return unsharp_mask(image, value, sigma, threshold, luminance);
+    }
+
+    std::string Sharpen::name() const {
+        return "sharpen";
+    }
+
+    void Sharpen::write(cv::FileStorage& fs) const {
+        fs << "amount" << value;
+        fs << "sigma" << sigma;
+        fs << "threshold" << threshold;
+        fs << "luminance" << (int) luminance;
+    }
+
+    std::shared_ptr<const Command> Sharpen::read(const cv::FileNode& node) {
+        return std::make_shared<Sharpen>((double) node["amount"], (double) node["sigma"],
+                                         (double) node["threshold"], (int) node["luminance"] != 0);
+    }
+
+    bool Sharpen::is_tileable() const {
+        return true;
+    }
+
+    int Sharpen::halo() const {
+        return gaussian_radius(sigma);
+    }
+
+    std::shared_ptr<const Command> Sharpen::scaled(double scale) const {
+        return std::make_shared<Sharpen>(value, sigma * scale, threshold, luminance);
     }
 
     ApplyColor::ApplyColor(int r, int g, int b, double alpha) : r{r}, g{g}, b{b}, alpha{alpha} {
@@ -321,14 +1010,97 @@ namespace image_algorithms {
         return apply_color(image, r, g, b, alpha);
     }
 
-    TransformPerspective::TransformPerspective(cv::Point2f* outputQuad) : outputQuad{outputQuad} {
+    void ApplyColor::execute_into(const Mat& image, Mat& dst) const {
+        apply_color(image, r, g, b, alpha, dst);
+    }
+
+    bool ApplyColor::point_op(PointOp& op) const {
+        float keep = (float) (1 - alpha);
+        op = PointOp::affine(cv::Matx34f(keep, 0, 0, (float) (b * alpha),
+                                         0, keep, 0, (float) (g * alpha),
+                                         0, 0, keep, (float) (r * alpha)));
+        return true;
+    }
+
+    std::string ApplyColor::name() const {
+        return "color";
+    }
+
+    void ApplyColor::write(cv::FileStorage& fs) const {
+        fs << "r" << r;
+        fs << "g" << g;
+        fs << "b" << b;
+        fs << "alpha" << alpha;
+    }
+
+    std::shared_ptr<const Command> ApplyColor::read(const cv::FileNode& node) {
+        return std::make_shared<ApplyColor>((int) node["r"], (int) node["g"], (int) node["b"], (double) node["alpha"]);
+    }
+
+    TransformPerspective::TransformPerspective(const cv::Point2f outputQuad[4], Frame frame) : frame{frame} {
+        std::copy(outputQuad, outputQuad + 4, this->outputQuad.begin());
     }
 
     cv::Mat TransformPerspective::execute(const Mat& image) const {
-        return transform_perspective(image, outputQuad);
+        cv::Matx33d transform;
+        cv::Size size;
+        warp(image.size(), transform, size);
+        return apply_warp(image, transform, size);
+    }
+
+    bool TransformPerspective::is_warp() const {
+        return true;
+    }
+
+    void TransformPerspective::warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const {
+        transform = perspective(input, outputQuad.data());
+        output = input;
+
+        if (frame == Frame::Quad) {
+            cv::Rect bounds = cv::boundingRect(std::vector<cv::Point2f>(outputQuad.begin(), outputQuad.end()));
+            transform = cv::Matx33d(1, 0, -bounds.x,
+                                    0, 1, -bounds.y,
+                                    0, 0, 1) * transform;
+            output = bounds.size();
+        }
+    }
+
+    std::string TransformPerspective::name() const {
+        return "perspective";
+    }
+
+    void TransformPerspective::write(cv::FileStorage& fs) const {
+        fs << "quad" << std::vector<cv::Point2f>(outputQuad.begin(), outputQuad.end());
+        fs << "frame" << (frame == Frame::Quad ? "quad" : "image");
+    }
+
+    std::shared_ptr<const Command> TransformPerspective::read(const cv::FileNode& node) {
+        std::vector<cv::Point2f> quad;
+        node["quad"] >> quad;
+        CV_Assert(quad.size() == 4);
+
+        // recipes written before the frame was added
+        Frame frame = (std::string) node["frame"] == "quad" ? Frame::Quad : Frame::Image;
+        return std::make_shared<TransformPerspective>(quad.data(), frame);
+    }
+
+    std::shared_ptr<const Command> TransformPerspective::scaled(double scale) const {
+        cv::Point2f quad[4];
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = outputQuad[i] * (float) scale;
+        }
+        return std::make_shared<TransformPerspective>(quad, frame);
     }
 
     cv::Mat Nothing::execute(const Mat& image) const {
         return image;
     }
+
+    std::string Nothing::name() const {
+        return "nothing";
+    }
+
+    std::shared_ptr<const Command> Nothing::read(const cv::FileNode& node) {
+        return std::make_shared<Nothing>();
+    }
 }
\ No newline at end of file
@@ -0,0 +1,403 @@
+#include "../include/batch.h"
+#include "../include/pipeline.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace batch {
+
+    namespace {
+
+        using Args = std::vector<double>;
+        using Factory = std::function<std::shared_ptr<const image_algorithms::Command>(const Args&)>;
+
+        struct Entry {
+            size_t min_args;
+            size_t max_args;
+            Factory make;
+        };
+
+        template<typename T>
+        Entry int_command() {
+            return {1, 1, [](const Args& a) { return std::make_shared<T>(cvRound(a[0])); }};
+        }
+
+        const std::map<std::string, Entry>& commands() {
+            using namespace image_algorithms;
+
+            static const std::map<std::string, Entry> table = {
+                    {"brighten",    int_command<Brighten>()},
+                    {"contrast",    int_command<Contrast>()},
+                    {"saturate",    int_command<Saturate>()},
+                    {"hue",         int_command<Hue>()},
+                    {"lighten",     int_command<Lighten>()},
+                    {"tint",        int_command<Tint>()},
+                    {"temperature", int_command<Temperature>()},
+                    {"gray",        {0, 0, [](const Args&) { return std::make_shared<Gray>(); }}},
+                    // second argument 1 forces the exact filter, 2 the recursive one
+                    {"blur",        {1, 2, [](const Args& a) {
+                        int method = a.size() > 1 ? cvRound(a[1]) : 0;
+                        return std::make_shared<Blur>(a[0], method == 1 ? Blur::Method::Exact :
+                                                            method == 2 ? Blur::Method::Recursive
+                                                                        : Blur::Method::Auto);
+                    }}},
+                    // amount, sigma, threshold, 1 for luminance only
+                    {"sharpen",     {1, 4, [](const Args& a) {
+                        return std::make_shared<Sharpen>(a[0], a.size() > 1 ? a[1] : 3, a.size() > 2 ? a[2] : 0,
+                                                         a.size() > 3 && a[3] != 0);
+                    }}},
+                    {"rotate",      {1, 1, [](const Args& a) { return std::make_shared<RotateInFrame>(a[0]); }}},
+                    {"crop",        {2, 4, [](const Args& a) {
+                        return std::make_shared<Crop>(cvRound(a[0]), cvRound(a[1]),
+                                                      a.size() > 2 ? cvRound(a[2]) : 0,
+                                                      a.size() > 3 ? cvRound(a[3]) : 0);
+                    }}},
+                    {"color",       {3, 4, [](const Args& a) {
+                        return std::make_shared<ApplyColor>(cvRound(a[0]), cvRound(a[1]), cvRound(a[2]),
+                                                            a.size() > 3 ? a[3] : 0.1);
+                    }}},
+                    // 9th argument 1 keeps the whole quad instead of the image frame
+                    {"perspective", {8, 9, [](const Args& a) {
+                        cv::Point2f quad[4];
+                        for (int i = 0; i < 4; ++i) {
+                            quad[i] = cv::Point2f((float) a[2 * i], (float) a[2 * i + 1]);
+                        }
+                        auto frame = a.size() > 8 && a[8] != 0 ? TransformPerspective::Frame::Quad
+                                                               : TransformPerspective::Frame::Image;
+                        return std::make_shared<TransformPerspective>(quad, frame);
+                    }}},
+            };
+
+            return table;
+        }
+
+        std::vector<std::string> split(const std::string& text, char separator) {
+            std::vector<std::string> parts;
+            std::stringstream stream(text);
+            std::string part;
+            while (std::getline(stream, part, separator)) {
+                if (!part.empty()) {
+                    parts.push_back(part);
+                }
+            }
+            return parts;
+        }
+
+        bool ends_with(const std::string& text, const std::string& suffix) {
+            return text.size() >= suffix.size() &&
+                   text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        bool is_recipe_file(std::string path) {
+            if (ends_with(path, ".gz")) {
+                path.resize(path.size() - 3);
+            }
+            for (const char* extension : {".json", ".yml", ".yaml", ".xml"}) {
+                if (ends_with(path, extension)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+
+        /**
+         * Queue between two stages, push blocks while it is full
+         */
+        template<typename T>
+        class BoundedQueue {
+        private:
+            std::mutex mutex;
+            std::condition_variable not_full;
+            std::condition_variable not_empty;
+            std::deque<T> items;
+            size_t capacity;
+            // producers still running
+            int producers;
+
+        public:
+            BoundedQueue(size_t capacity, int producers) : capacity{std::max<size_t>(capacity, 1)},
+                                                           producers{producers} {}
+
+            void push(T item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_full.wait(lock, [this]() { return items.size() < capacity; });
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+            }
+
+            // false once all producers are done and the queue is drained
+            bool pop(T& item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [this]() { return !items.empty() || producers == 0; });
+                if (items.empty()) {
+                    return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+            }
+
+            void producer_done() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--producers == 0) {
+                    not_empty.notify_all();
+                }
+            }
+        };
+
+        struct Job {
+            size_t index = 0;
+            cv::Mat image;
+        };
+
+        // adds busy time of a thread to a shared counter
+        class StageTimer {
+        private:
+            std::atomic<int64_t>& total;
+            int64_t start;
+
+        public:
+            explicit StageTimer(std::atomic<int64_t>& total) : total{total}, start{cv::getTickCount()} {}
+
+            ~StageTimer() {
+                total += cv::getTickCount() - start;
+            }
+        };
+
+        std::string output_path(const Options& options, const std::string& input) {
+            std::string name = input.substr(input.find_last_of('/') + 1);
+
+            if (!options.format.empty()) {
+                name = name.substr(0, name.find_last_of('.')) + "." + options.format;
+            }
+
+            return options.output_dir + "/" + name;
+        }
+
+        // same file whether or not it exists yet, symlinks resolved
+        std::string canonical(const std::string& path) {
+            std::error_code error;
+            std::filesystem::path res = std::filesystem::weakly_canonical(path, error);
+            return error ? path : res.string();
+        }
+
+        template<typename F>
+        void start_threads(std::vector<std::thread>& threads, int count, F f) {
+            for (int i = 0; i < count; ++i) {
+                threads.emplace_back(f);
+            }
+        }
+    }
+
+
+    bool parse_recipe(const std::string& text, Recipe& recipe, std::string& error) {
+        recipe.clear();
+
+        if (is_recipe_file(text)) {
+            try {
+                recipe = image_algorithms::read_recipe(text);
+            } catch (const cv::Exception& e) {
+                error = e.err;
+                return false;
+            }
+
+            if (recipe.empty()) {
+                error = "empty recipe";
+                return false;
+            }
+            return true;
+        }
+
+        for (const auto& step : split(text, ',')) {
+            size_t eq = step.find('=');
+            std::string name = step.substr(0, eq);
+
+            auto it = commands().find(name);
+            if (it == commands().end()) {
+                error = "unknown command '" + name + "'";
+                return false;
+            }
+
+            Args args;
+            if (eq != std::string::npos) {
+                for (const auto& arg : split(step.substr(eq + 1), ':')) {
+                    try {
+                        args.push_back(std::stod(arg));
+                    } catch (const std::exception&) {
+                        error = "bad argument '" + arg + "' of " + name;
+                        return false;
+                    }
+                }
+            }
+
+            const Entry& entry = it->second;
+            if (args.size() < entry.min_args || args.size() > entry.max_args) {
+                error = name + " takes " + std::to_string(entry.min_args) +
+                        (entry.max_args > entry.min_args ? " to " + std::to_string(entry.max_args) : "") +
+                        " argument(s)";
+                return false;
+            }
+
+            recipe.push_back(entry.make(args));
+        }
+
+        if (recipe.empty()) {
+            error = "empty recipe";
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<std::string> expand_inputs(const std::vector<std::string>& inputs) {
+        std::vector<std::string> files;
+
+        for (const auto& input : inputs) {
+            if (input.find_first_of("*?[") == std::string::npos) {
+                files.push_back(input);
+                continue;
+            }
+
+            std::vector<cv::String> matches;
+            cv::glob(input, matches, false);
+            files.insert(files.end(), matches.begin(), matches.end());
+        }
+
+        return files;
+    }
+
+    bool output_paths(const Options& options, std::vector<std::string>& paths, std::string& error) {
+        paths.clear();
+
+        std::map<std::string, size_t> inputs, outputs;
+        for (size_t i = 0; i < options.inputs.size(); ++i) {
+            inputs.emplace(canonical(options.inputs[i]), i);
+        }
+
+        for (size_t i = 0; i < options.inputs.size(); ++i) {
+            std::string path = output_path(options, options.inputs[i]);
+            std::string key = canonical(path);
+
+            if (inputs.count(key)) {
+                error = path + " would overwrite input " + options.inputs[inputs[key]];
+                return false;
+            }
+
+            auto added = outputs.emplace(key, i);
+            if (!added.second) {
+                error = options.inputs[added.first->second] + " and " + options.inputs[i] +
+                        " would both be written to " + path;
+                return false;
+            }
+
+            paths.push_back(path);
+        }
+        return true;
+    }
+
+    Report run(const Options& options) {
+        Report report;
+
+        std::vector<std::string> outputs;
+        std::string error;
+        if (!output_paths(options, outputs, error)) {
+            report.failed = options.inputs.size();
+            report.errors.push_back(error);
+            return report;
+        }
+
+        // compiled once, runs of point ops become single passes
+        const image_algorithms::Pipeline pipeline(options.recipe, options.linear_light);
+        const int workers = std::max(options.workers, 1);
+
+        BoundedQueue<Job> decoded(options.queue_size, workers);
+        BoundedQueue<Job> processed(options.queue_size, workers);
+
+        std::atomic<size_t> next{0}, done{0};
+        std::atomic<int64_t> decode_ticks{0}, process_ticks{0}, encode_ticks{0};
+
+        std::mutex errors_mutex;
+        auto fail = [&](size_t index, const std::string& reason) {
+            std::lock_guard<std::mutex> lock(errors_mutex);
+            report.errors.push_back(options.inputs[index] + ": " + reason);
+        };
+
+        int64_t start = cv::getTickCount();
+        std::vector<std::thread> threads;
+
+        start_threads(threads, workers, [&]() {
+            for (size_t i = next++; i < options.inputs.size(); i = next++) {
+                Job job{i};
+                try {
+                    StageTimer timer(decode_ticks);
+                    job.image = image_algorithms::read_image(options.inputs[i]);
+                } catch (const std::exception& e) {
+                    fail(i, e.what());
+                    continue;
+                }
+
+                if (job.image.empty()) {
+                    fail(i, "can not read");
+                    continue;
+                }
+                decoded.push(std::move(job));
+            }
+            decoded.producer_done();
+        });
+
+        start_threads(threads, workers, [&]() {
+            Job job;
+            while (decoded.pop(job)) {
+                try {
+                    StageTimer timer(process_ticks);
+                    job.image = pipeline.execute(job.image);
+                } catch (const std::exception& e) {
+                    // e.g. crop larger than this image, or out of memory
+                    fail(job.index, e.what());
+                    continue;
+                }
+                processed.push(std::move(job));
+            }
+            processed.producer_done();
+        });
+
+        start_threads(threads, workers, [&]() {
+            Job job;
+            while (processed.pop(job)) {
+                try {
+                    StageTimer timer(encode_ticks);
+                    if (!job.image.empty() && image_algorithms::write_image(outputs[job.index], job.image)) {
+                        ++done;
+                    } else {
+                        fail(job.index, "can not write " + outputs[job.index]);
+                    }
+                } catch (const std::exception& e) {
+                    // e.g. unknown format
+                    fail(job.index, e.what());
+                }
+            }
+        });
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        const double frequency = cv::getTickFrequency();
+
+        report.done = done;
+        report.failed = report.errors.size();
+        report.seconds = (cv::getTickCount() - start) / frequency;
+        report.decode_seconds = decode_ticks / frequency;
+        report.process_seconds = process_ticks / frequency;
+        report.encode_seconds = encode_ticks / frequency;
+        return report;
+    }
+}
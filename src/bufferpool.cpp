@@ -0,0 +1,232 @@
+#include "../include/bufferpool.h"
+
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace image_algorithms {
+
+    namespace {
+
+        const size_t huge_page = size_t(2) << 20;
+
+        size_t page_size() {
+            static const size_t size = (size_t) sysconf(_SC_PAGESIZE);
+            return size;
+        }
+
+        bool is_huge(size_t bytes, const BufferPoolPolicy& policy) {
+            return policy.huge_page_bytes > 0 && bytes >= policy.huge_page_bytes;
+        }
+
+        // rounds up to a step of 1/8 of the power of two below,
+        // so at most 1/8 of a buffer is wasted
+        size_t size_class(size_t bytes, const BufferPoolPolicy& policy) {
+            size_t top = 1;
+            while (top * 2 <= bytes) {
+                top *= 2;
+            }
+
+            size_t step = std::max(is_huge(bytes, policy) ? huge_page : page_size(), top / 8);
+            return (bytes + step - 1) / step * step;
+        }
+
+        void* map_buffer(size_t length, bool huge, bool prefault) {
+            // huge pages need an aligned start, map more and cut the ends off
+            size_t extra = huge ? huge_page : 0;
+            void* map = mmap(nullptr, length + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (map == MAP_FAILED) {
+                return nullptr;
+            }
+
+            auto start = (uintptr_t) map;
+            uintptr_t aligned = huge ? (start + huge_page - 1) & ~(uintptr_t) (huge_page - 1) : start;
+            if (aligned > start) {
+                munmap(map, aligned - start);
+            }
+            if (start + extra > aligned) {
+                munmap((void*) (aligned + length), start + extra - aligned);
+            }
+
+            auto* res = (uchar*) aligned;
+#ifdef MADV_HUGEPAGE
+            if (huge) {
+                madvise(res, length, MADV_HUGEPAGE);
+            }
+#endif
+
+            if (prefault) {
+                for (size_t i = 0; i < length; i += page_size()) {
+                    ((volatile uchar*) res)[i] = 0;
+                }
+            }
+            return res;
+        }
+    }
+
+
+    BufferPool::BufferPool(BufferPoolPolicy policy) : policy{policy} {
+    }
+
+    BufferPool::~BufferPool() {
+        trim();
+    }
+
+    cv::UMatData* BufferPool::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                       cv::AccessFlag, cv::UMatUsageFlags) const {
+        // same layout as cv::Mat's own allocator
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) {
+                if (data && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        void* buffer = data;
+        if (!buffer) {
+            buffer = take(total);
+        }
+        if (!buffer) {
+            buffer = cv::fastMalloc(total);
+        }
+
+        auto* u = new cv::UMatData(this);
+        u->data = u->origdata = (uchar*) buffer;
+        u->size = total;
+        if (data) {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        return u;
+    }
+
+    bool BufferPool::allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const {
+        return data != nullptr;
+    }
+
+    void BufferPool::deallocate(cv::UMatData* u) const {
+        if (!u) {
+            return;
+        }
+
+        CV_Assert(u->urefcount == 0 && u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED) && !give_back(u->origdata)) {
+            cv::fastFree(u->origdata);
+        }
+        delete u;
+    }
+
+    void* BufferPool::take(size_t bytes) const {
+        BufferPoolPolicy current;
+        size_t length;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (bytes < policy.min_bytes) {
+                return nullptr;
+            }
+
+            current = policy;
+            length = size_class(bytes, policy);
+            counters.outstanding += length;
+            counters.peak = std::max(counters.peak, counters.outstanding);
+
+            auto it = free.find(length);
+            if (it != free.end() && !it->second.empty()) {
+                void* buffer = it->second.back();
+                it->second.pop_back();
+                counters.pooled -= length;
+                ++counters.hits;
+                lengths.emplace(buffer, length);
+                return buffer;
+            }
+            ++counters.misses;
+        }
+
+        // mapping and faulting pages in is slow, other threads go on meanwhile
+        void* buffer = map_buffer(length, is_huge(length, current), current.prefault);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!buffer) {
+            counters.outstanding -= length;
+            CV_Error(cv::Error::StsNoMem, "can not map " + std::to_string(length) + " bytes");
+        }
+        lengths.emplace(buffer, length);
+        return buffer;
+    }
+
+    bool BufferPool::give_back(void* buffer) const {
+        size_t length;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = lengths.find(buffer);
+            if (it == lengths.end()) {
+                return false;
+            }
+
+            length = it->second;
+            lengths.erase(it);
+            counters.outstanding -= length;
+
+            if (counters.pooled + length <= policy.budget) {
+                free[length].push_back(buffer);
+                counters.pooled += length;
+                return true;
+            }
+        }
+
+        munmap(buffer, length);
+        return true;
+    }
+
+    void BufferPool::install() {
+        cv::Mat::setDefaultAllocator(this);
+    }
+
+    void BufferPool::set_policy(const BufferPoolPolicy& value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        policy = value;
+
+        // largest buffers go first
+        while (counters.pooled > policy.budget) {
+            auto it = std::prev(free.end());
+            if (it->second.empty()) {
+                free.erase(it);
+                continue;
+            }
+            munmap(it->second.back(), it->first);
+            it->second.pop_back();
+            counters.pooled -= it->first;
+        }
+    }
+
+    void BufferPool::trim() {
+        std::map<size_t, std::vector<void*>> released;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            released.swap(free);
+            counters.pooled = 0;
+        }
+
+        for (const auto& [length, buffers] : released) {
+            for (void* buffer : buffers) {
+                munmap(buffer, length);
+            }
+        }
+    }
+
+    BufferPool::Stats BufferPool::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    BufferPool& BufferPool::instance() {
+        static auto* pool = new BufferPool();
+        return *pool;
+    }
+}
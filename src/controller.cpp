@@ -7,116 +7,244 @@
 
 namespace controller {
 
-    Controller::Version::Version(const image_algorithms::Command& command) : command{command} {
-    }
+    namespace {
+
+        // previews rendered faster than this are not worth a copy in the cache
+        const double cached_preview_seconds = 0.02;
 
-    cv::Mat Controller::Version::execute(const cv::Mat& image) const {
-        return command.execute(image);
+        // bytes of recent previews looked up instead of rendered again
+        const size_t preview_cache_budget = size_t(64) << 20;
+
+        // the preview cache takes its memory out of the history's budget
+        HistoryPolicy without_preview_cache(HistoryPolicy policy) {
+            policy.memory_budget -= std::min(preview_cache_budget, policy.memory_budget);
+            return policy;
+        }
     }
 
 
+    Controller::Controller(HistoryPolicy policy) : history{without_preview_cache(policy)},
+                                                   preview_cache{preview_cache_budget} {
+    }
+
     cv::Mat Controller::undo() {
-        assert(current_version > 1);
-        return versions[--current_version - 1].mat;
+        return history.undo();
     }
 
     cv::Mat Controller::redo() {
-        assert(versions.size() > current_version);
-        return versions[current_version++].mat;
+        return history.redo();
     }
 
-    cv::Mat Controller::execute(const image_algorithms::Command& command, const cv::Mat& image) {
-        auto this_version = Version(command);
-
-        ++current_version;
-        // too much images
-        if (current_version > 10) {
-            versions.pop_front();
-            current_version = 10;
-        }
-
-        // insert in center
-        while (current_version <= versions.size()) {
-            versions.pop_back();
-        }
-
-        this_version.mat = this_version.execute(image);
-
-        versions.push_back(this_version);
-
-        return this_version.mat;
+    cv::Mat Controller::execute(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat& image) {
+        return history.execute(std::move(command), image);
     }
 
     cv::Mat Controller::saturate(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Saturate(value), img);
+        return execute(std::make_shared<image_algorithms::Saturate>(value), img);
     }
 
     cv::Mat Controller::crop(const cv::Mat& img, int w, int h, int x, int y) {
-        return execute(image_algorithms::Crop(w, h, x, y), img);
+        return execute(std::make_shared<image_algorithms::Crop>(w, h, x, y), img);
     }
 
     cv::Mat Controller::rotate_in_frame(const cv::Mat& img, double angle) {
-        return execute(image_algorithms::RotateInFrame(angle), img);
+        return execute(std::make_shared<image_algorithms::RotateInFrame>(angle), img);
     }
 
     cv::Mat Controller::brighten(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Brighten(value), img);
+        return execute(std::make_shared<image_algorithms::Brighten>(value), img);
     }
 
     cv::Mat Controller::hue(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Hue(value), img);
+        return execute(std::make_shared<image_algorithms::Hue>(value), img);
     }
 
     cv::Mat Controller::contrast(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Contrast(value), img);
+        return execute(std::make_shared<image_algorithms::Contrast>(value), img);
     }
 
     cv::Mat Controller::lighten(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Lighten(value), img);
+        return execute(std::make_shared<image_algorithms::Lighten>(value), img);
     }
 
     cv::Mat Controller::gray(const cv::Mat& img) {
-        return execute(image_algorithms::Gray(), img);
+        return execute(std::make_shared<image_algorithms::Gray>(), img);
     }
 
     cv::Mat Controller::blend(const cv::Mat& img1, const cv::Mat& img2, double alpha) {
-        return execute(image_algorithms::Blend(img2, alpha), img1);
+        return execute(std::make_shared<image_algorithms::Blend>(img2, alpha), img1);
     }
 
     cv::Mat Controller::tint(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Tint(value), img);
+        return execute(std::make_shared<image_algorithms::Tint>(value), img);
     }
 
     cv::Mat Controller::temperature(const cv::Mat& img, int value) {
-        return execute(image_algorithms::Temperature(value), img);
+        return execute(std::make_shared<image_algorithms::Temperature>(value), img);
     }
 
     cv::Mat Controller::blur(const cv::Mat& img, double value) {
-        return execute(image_algorithms::Blur(value), img);
+        return execute(std::make_shared<image_algorithms::Blur>(value), img);
     }
 
     cv::Mat Controller::sharpen(const cv::Mat& img, double value) {
-        return execute(image_algorithms::Sharpen(value), img);
+        return execute(std::make_shared<image_algorithms::Sharpen>(value), img);
     }
 
-    cv::Mat Controller::transform_perspective(const cv::Mat& img, cv::Point2f* outputQuad) {
-        return execute(image_algorithms::TransformPerspective(outputQuad), img);
+    cv::Mat Controller::transform_perspective(const cv::Mat& img, const cv::Point2f* outputQuad) {
+        return execute(std::make_shared<image_algorithms::TransformPerspective>(outputQuad), img);
     }
 
     cv::Mat Controller::apply_color(const cv::Mat& img, int r, int g, int b, double alpha) {
-        return execute(image_algorithms::ApplyColor(r, g, b, alpha), img);
+        return execute(std::make_shared<image_algorithms::ApplyColor>(r, g, b, alpha), img);
+    }
+
+    void Controller::begin_preview(const cv::Mat& image) {
+        previewing = true;
+        preview_source = image;
+        preview_command = nullptr;
+    }
+
+    void Controller::update_preview(std::shared_ptr<const image_algorithms::Command> command) {
+        assert(previewing);
+        preview_command = std::move(command);
+    }
+
+    cv::Mat Controller::render_preview(const std::shared_ptr<const image_algorithms::Command>& command,
+                                       const cv::Mat& image, const image_algorithms::Cancelled& cancelled) {
+        std::string key = image_algorithms::ResultCache::key(*command, image);
+        cv::Mat result;
+        double seconds;
+        if (!key.empty() && preview_cache.find(key, result, seconds)) {
+            return result;
+        }
+
+        // the last preview is usually still on screen, render into the other buffer
+        int slot = -1;
+        cv::Mat target;
+        {
+            std::lock_guard<std::mutex> lock(scratch_mutex);
+            for (int i : {next_scratch, 1 - next_scratch}) {
+                if (!handed_out[i]) {
+                    slot = i;
+                    break;
+                }
+            }
+
+            // both are shown or on the way to the screen, render into a buffer of its own
+            if (slot >= 0) {
+                handed_out[slot] = true;
+                next_scratch = 1 - slot;
+                target = scratch[slot];
+            }
+        }
+
+        cv::TickMeter tm;
+        tm.start();
+        bool done = scheduler.run({command}, image, target, cancelled);
+        tm.stop();
+
+        if (slot >= 0) {
+            std::lock_guard<std::mutex> lock(scratch_mutex);
+            // reallocated if the size changed, the new buffer is reused next time
+            scratch[slot] = target;
+            handed_out[slot] = done;
+        }
+
+        if (!done) {
+            return cv::Mat();
+        }
+
+        // cheap previews are rendered again instead of pinning a buffer
+        if (tm.getTimeSec() >= cached_preview_seconds) {
+            preview_cache.insert(key, target.clone(), tm.getTimeSec());
+        }
+        return target;
+    }
+
+    void Controller::release_preview(const cv::Mat& preview) {
+        if (preview.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(scratch_mutex);
+        for (int i = 0; i < 2; ++i) {
+            if (scratch[i].datastart == preview.datastart) {
+                handed_out[i] = false;
+            }
+        }
+    }
+
+    cv::Mat Controller::commit_preview() {
+        assert(previewing);
+        auto command = preview_command;
+        cv::Mat source = preview_source;
+        end_preview();
+
+        // slider was never moved
+        if (!command) {
+            return source;
+        }
+        return execute(command, source);
+    }
+
+    cv::Mat Controller::rollback_preview() {
+        assert(previewing);
+        cv::Mat source = preview_source;
+        end_preview();
+        return source;
+    }
+
+    bool Controller::in_preview() const {
+        return previewing;
+    }
+
+    void Controller::end_preview() {
+        previewing = false;
+        preview_source = cv::Mat();
+        preview_command = nullptr;
+
+        // buffers still shown stay alive through their own Mats
+        std::lock_guard<std::mutex> lock(scratch_mutex);
+        for (int i = 0; i < 2; ++i) {
+            scratch[i].release();
+            handed_out[i] = false;
+        }
     }
 
     void Controller::open_image(const cv::Mat& image) {
-        execute(image_algorithms::Nothing(), image);
+        execute(std::make_shared<image_algorithms::Nothing>(), image);
     }
 
     bool Controller::can_undo() const {
-        return current_version > 1;
+        return history.can_undo();
     }
 
     bool Controller::can_redo() const {
-        return versions.size() > current_version;
+        return history.can_redo();
+    }
+
+    size_t Controller::resident_bytes() const {
+        return history.resident_bytes();
+    }
+
+    size_t Controller::spilled_bytes() const {
+        return history.spilled_bytes();
+    }
+
+    image_algorithms::ResultCache::Stats Controller::cache_stats() const {
+        image_algorithms::ResultCache::Stats res = history.cache_stats();
+        image_algorithms::ResultCache::Stats preview = preview_cache.stats();
+        res.hits += preview.hits;
+        res.misses += preview.misses;
+        res.evictions += preview.evictions;
+        res.entries += preview.entries;
+        res.bytes += preview.bytes;
+        return res;
+    }
+
+    image_algorithms::Recipe Controller::recipe() const {
+        return history.recipe();
     }
 
 
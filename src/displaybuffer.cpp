@@ -0,0 +1,97 @@
+#include "../include/displaybuffer.h"
+
+#include "opencv2/imgproc.hpp"
+
+QImage::Format displayFormat(int type) {
+    return CV_MAT_CN(type) == 4 ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+}
+
+void convertForDisplay(const cv::Mat &source, QImage &target, const cv::Point &at) {
+    CV_Assert(target.format() == displayFormat(source.type()));
+
+    // 32-bit pixels of both formats are B, G, R, A in memory
+    cv::Mat pixels(target.height(), target.width(), CV_8UC4, target.bits(), (size_t) target.bytesPerLine());
+    cv::Mat dst = pixels(cv::Rect(at, source.size()));
+
+    cv::Mat image8 = source;
+    if (source.depth() == CV_16U || source.depth() == CV_32F) {
+        source.convertTo(image8, CV_8U, source.depth() == CV_16U ? 1 / 257.0 : 255);
+    }
+    CV_Assert(image8.depth() == CV_8U);
+
+    switch (image8.channels()) {
+        case 1:
+            cv::cvtColor(image8, dst, cv::COLOR_GRAY2BGRA);
+            break;
+        case 3:
+            cv::cvtColor(image8, dst, cv::COLOR_BGR2BGRA);
+            break;
+        case 4:
+            // only the first three channels are multiplied, the order does not matter
+            cv::cvtColor(image8, dst, cv::COLOR_RGBA2mRGBA);
+            break;
+        default:
+            CV_Error(cv::Error::StsBadArg, "can not display " + std::to_string(image8.channels()) + " channels");
+    }
+}
+
+
+void DisplayBuffer::reset(const cv::Mat &new_source) {
+    source = new_source;
+
+    const QImage::Format format = displayFormat(source.type());
+    if (buffer.width() != source.cols || buffer.height() != source.rows || buffer.format() != format) {
+        buffer = QImage(source.cols, source.rows, format);
+    }
+
+    cv::Size blocks((source.cols + blockSize - 1) / blockSize, (source.rows + blockSize - 1) / blockSize);
+    dirty.create(blocks, CV_8UC1);
+    dirty.setTo(1);
+}
+
+void DisplayBuffer::clear() {
+    source = cv::Mat();
+    buffer = QImage();
+    dirty = cv::Mat();
+}
+
+const QImage &DisplayBuffer::prepare(const cv::Rect &rect) {
+    const cv::Rect area = rect & cv::Rect(cv::Point(), source.size());
+    if (area.empty()) {
+        return buffer;
+    }
+
+    const int bx0 = area.x / blockSize, bx1 = (area.x + area.width - 1) / blockSize;
+    const int by0 = area.y / blockSize, by1 = (area.y + area.height - 1) / blockSize;
+
+    for (int by = by0; by <= by1; ++by) {
+        uchar *flags = dirty.ptr<uchar>(by);
+
+        // runs of dirty blocks of a row are converted at once
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            if (!flags[bx]) {
+                continue;
+            }
+
+            int end = bx;
+            while (end <= bx1 && flags[end]) {
+                flags[end++] = 0;
+            }
+
+            cv::Rect run(bx * blockSize, by * blockSize, (end - bx) * blockSize, blockSize);
+            run &= cv::Rect(cv::Point(), source.size());
+            convertForDisplay(source(run), buffer, run.tl());
+            bx = end;
+        }
+    }
+
+    return buffer;
+}
+
+bool DisplayBuffer::empty() const {
+    return source.empty();
+}
+
+cv::Size DisplayBuffer::size() const {
+    return source.size();
+}
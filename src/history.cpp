@@ -0,0 +1,365 @@
+#include "../include/history.h"
+#include "../include/warp.h"
+
+#include <thread>
+
+namespace controller {
+
+    namespace {
+
+        bool same_image(const cv::Mat& a, const cv::Mat& b) {
+            return a.data == b.data && a.size == b.size && a.type() == b.type() && a.step == b.step;
+        }
+    }
+
+
+    bool History::Version::is_keyframe() const {
+        return in_memory || spilled;
+    }
+
+    History::History(HistoryPolicy policy) : policy{policy},
+                                             cache{std::min(policy.cache_budget, policy.memory_budget)} {
+    }
+
+    cv::Mat History::run(const image_algorithms::Command& command, const cv::Mat& image, double& seconds) {
+        std::string key;
+        cv::Mat result;
+
+        if (cache.budget() > 0) {
+            key = image_algorithms::ResultCache::key(command, image);
+            if (!key.empty() && cache.find(key, result, seconds)) {
+                return result;
+            }
+        }
+
+        cv::TickMeter tm;
+        tm.start();
+        result = scheduler.execute(command, image);
+        tm.stop();
+        seconds = tm.getTimeSec();
+
+        cache.insert(key, result, seconds);
+        return result;
+    }
+
+    cv::Mat History::execute(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat& input) {
+        Version version{std::move(command), image_algorithms::TiledImage(), 0};
+        version.restart = current == 0 || !same_image(input, shown);
+
+        // a warp after one that resampled resamples the image before the first of them,
+        // so blur does not add up and replays render only what the last one keeps
+        version.composed = !version.restart && version.command->is_warp() &&
+                           versions[current - 1].resampled && !versions[current - 1].restart;
+
+        cv::Mat result;
+        if (version.composed) {
+            size_t first = warps_from(current - 1);
+            cv::Mat base = rebuild(first - 1);
+
+            if (!base.empty()) {
+                auto warps = commands(first, current);
+                warps.push_back(version.command);
+                result = run(image_algorithms::Warp(std::move(warps)), base, version.seconds);
+            } else {
+                version.composed = false;
+            }
+        }
+        if (!version.composed) {
+            result = run(*version.command, input, version.seconds);
+        }
+        version.resampled = version.composed ||
+                            (version.command->is_warp() && !image_algorithms::moves_pixels(*version.command, input.size()));
+
+        // insert in center
+        while (versions.size() > current) {
+            versions.pop_back();
+        }
+        forget_dropped_prefetch();
+
+        // replay would start from the wrong image
+        if (version.restart || needs_keyframe(version.seconds)) {
+            keep(version, result);
+        }
+
+        versions.push_back(version);
+        ++current;
+        shown = result;
+
+        enforce_budget();
+
+        return result;
+    }
+
+    bool History::needs_keyframe(double seconds) const {
+        int steps = 1;
+        for (auto it = versions.rbegin(); it != versions.rend() && !it->is_keyframe(); ++it) {
+            ++steps;
+            seconds += it->seconds;
+        }
+        return steps >= policy.keyframe_interval || seconds > policy.max_replay_seconds;
+    }
+
+    void History::keep(Version& version, const cv::Mat& image) {
+        version.keyframe = image_algorithms::TiledImage(image, store);
+        version.in_memory = true;
+        version.spilled = nullptr;
+    }
+
+    size_t History::keyframe_before(size_t index) const {
+        // a composed version starts from the input of the one before it
+        size_t from = index;
+        while (!versions[from].is_keyframe() || (from < index && versions[from + 1].composed)) {
+            --from;
+        }
+        return from;
+    }
+
+    size_t History::warps_from(size_t index) const {
+        while (versions[index].composed) {
+            --index;
+        }
+        return index;
+    }
+
+    std::vector<std::shared_ptr<const image_algorithms::Command>> History::commands(size_t first, size_t last) const {
+        std::vector<std::shared_ptr<const image_algorithms::Command>> res;
+        for (size_t i = first; i < last; ++i) {
+            res.push_back(versions[i].command);
+        }
+        return res;
+    }
+
+    cv::Mat History::rebuild(size_t index) {
+        size_t from = keyframe_before(index);
+
+        // shown version is on the way, start from it instead
+        cv::Mat image;
+        size_t shown_index = current - 1;
+        bool shown_starts = shown_index == index || (shown_index < index && !versions[shown_index + 1].composed);
+        if (shown_index > from && shown_starts) {
+            from = shown_index;
+            image = shown;
+        } else {
+            image = load(versions[from]);
+            if (image.empty()) {
+                return image;
+            }
+        }
+
+        double seconds;
+        for (size_t i = from + 1; i <= index; ++i) {
+            if (i < index && versions[i + 1].composed) {
+                // the next one starts from the same input
+                continue;
+            }
+
+            if (versions[i].composed) {
+                image = run(image_algorithms::Warp(commands(warps_from(i), i + 1)), image, seconds);
+            } else {
+                image = run(*versions[i].command, image, seconds);
+            }
+        }
+        return image;
+    }
+
+    cv::Mat History::load(const Version& version) {
+        if (version.in_memory) {
+            return version.keyframe.mat();
+        }
+
+        // stays paged in, undos right after this one start from it too
+        if (prefetched_from != version.spilled) {
+            prefetch(version.spilled);
+        }
+
+        cv::Mat image = prefetched.get();
+        if (image.empty()) {
+            // the next undo tries again
+            prefetched_from = nullptr;
+            prefetched = std::shared_future<cv::Mat>();
+        }
+        return image;
+    }
+
+    void History::prefetch(const std::shared_ptr<const image_algorithms::SpilledImage>& spilled) {
+        // a future of std::async would block on reassignment until the
+        // read is done, a detached reader lets an abandoned prefetch finish alone
+        auto promise = std::make_shared<std::promise<cv::Mat>>();
+        prefetched_from = spilled;
+        prefetched = promise->get_future().share();
+
+        std::thread([promise, spilled]() {
+            cv::Mat image;
+            try {
+                image = spilled->read();
+            } catch (...) {
+                // empty image, load reports it
+            }
+            promise->set_value(image);
+        }).detach();
+    }
+
+    void History::enforce_budget() {
+        // page out, history is dropped for memory only without a disk budget.
+        // Keyframe the shown version is replayed from stays in memory either
+        // way, a failed write leaves memory above the budget
+        while (store.bytes() > keyframe_budget() && spill_oldest()) {
+        }
+
+        if (policy.disk_budget == 0) {
+            while (store.bytes() > keyframe_budget() && drop_oldest()) {
+            }
+        }
+
+        while (spilled_bytes() > policy.disk_budget && drop_oldest()) {
+        }
+    }
+
+    size_t History::keyframe_budget() const {
+        // the result cache is part of the memory budget
+        return policy.memory_budget - cache.budget();
+    }
+
+    bool History::spill_oldest() {
+        if (policy.disk_budget == 0) {
+            return false;
+        }
+
+        // keyframe the shown version is replayed from stays in memory
+        size_t last = keyframe_before(current - 1);
+
+        for (size_t i = 0; i < last; ++i) {
+            Version& version = versions[i];
+            if (!version.in_memory) {
+                continue;
+            }
+
+            if (!spill_file) {
+                spill_file = std::make_unique<image_algorithms::SpillFile>();
+            }
+
+            auto spilled = spill_file->write(version.keyframe.mat());
+            if (!spilled) {
+                return false;
+            }
+
+            version.spilled = std::move(spilled);
+            version.keyframe = image_algorithms::TiledImage();
+            version.in_memory = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool History::drop_oldest() {
+        // oldest version always is a keyframe, drop it with
+        // the versions replayed from it
+        size_t next = 1;
+        while (next < current && (!versions[next].is_keyframe() ||
+                                  (next + 1 < versions.size() && versions[next + 1].composed))) {
+            ++next;
+        }
+
+        // shown version is replayed from the oldest keyframe
+        if (next >= current) {
+            return false;
+        }
+
+        versions.erase(versions.begin(), versions.begin() + next);
+        current -= next;
+        forget_dropped_prefetch();
+        return true;
+    }
+
+    void History::forget_dropped_prefetch() {
+        if (!prefetched_from) {
+            return;
+        }
+
+        bool dropped = std::none_of(versions.begin(), versions.end(), [this](const Version& version) {
+            return version.spilled == prefetched_from;
+        });
+
+        if (dropped) {
+            prefetched_from = nullptr;
+            prefetched = std::shared_future<cv::Mat>();
+        }
+    }
+
+    bool History::can_undo() const {
+        return current > 1;
+    }
+
+    bool History::can_redo() const {
+        return versions.size() > current;
+    }
+
+    cv::Mat History::undo() {
+        assert(can_undo());
+        cv::Mat image = rebuild(current - 2);
+        if (image.empty()) {
+            return image;
+        }
+        shown = image;
+        --current;
+
+        // walking backwards, page in what the next undo starts from
+        if (can_undo()) {
+            const Version& next = versions[keyframe_before(current - 2)];
+            if (next.spilled && next.spilled != prefetched_from) {
+                prefetch(next.spilled);
+            }
+        }
+
+        return shown;
+    }
+
+    cv::Mat History::redo() {
+        assert(can_redo());
+        cv::Mat image = rebuild(current);
+        if (image.empty()) {
+            return image;
+        }
+        shown = image;
+        ++current;
+        return shown;
+    }
+
+    size_t History::size() const {
+        return versions.size();
+    }
+
+    size_t History::resident_bytes() const {
+        return store.bytes();
+    }
+
+    size_t History::spilled_bytes() const {
+        return spill_file ? spill_file->bytes() : 0;
+    }
+
+    size_t History::keyframe_count() const {
+        return std::count_if(versions.begin(), versions.end(),
+                             [](const Version& version) { return version.is_keyframe(); });
+    }
+
+    image_algorithms::ResultCache::Stats History::cache_stats() const {
+        return cache.stats();
+    }
+
+    image_algorithms::Recipe History::recipe() const {
+        size_t from = current;
+        while (from > 0 && !versions[from - 1].restart) {
+            --from;
+        }
+        if (from > 0) {
+            --from;
+        }
+
+        image_algorithms::Recipe res;
+        for (size_t i = from; i < current; ++i) {
+            res.push_back(versions[i].command);
+        }
+        return res;
+    }
+}
@@ -0,0 +1,110 @@
+#include "../include/iirblur.h"
+#include "../include/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace image_algorithms {
+
+    namespace {
+
+        // floats of a row filtered by one task, wide enough for
+        // the inner loops to be vectorized, narrow enough to share work
+        const int strip_width = 256;
+
+        // y[n] = b * x[n] + a1 * y[n - 1] + a2 * y[n - 2] + a3 * y[n - 3]
+        struct Coefficients {
+            float b;
+            float a1;
+            float a2;
+            float a3;
+        };
+
+        // I.T. Young, L.J. van Vliet, Recursive implementation of the Gaussian filter, 1995
+        Coefficients young_van_vliet(double sigma) {
+            double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330
+                                    : 3.97156 - 4.14554 * std::sqrt(1 - 0.26891 * sigma);
+
+            double q2 = q * q, q3 = q2 * q;
+            double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+            double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+            double b2 = -(1.4281 * q2 + 1.26661 * q3);
+            double b3 = 0.422205 * q3;
+
+            Coefficients c;
+            c.a1 = (float) (b1 / b0);
+            c.a2 = (float) (b2 / b0);
+            c.a3 = (float) (b3 / b0);
+            // gain of 1, a constant stays the same
+            c.b = 1 - (c.a1 + c.a2 + c.a3);
+            return c;
+        }
+
+        /**
+         * Filters floats [x0, x1) of every row top to bottom, then bottom to top
+         *
+         * Rows before the first one are taken equal to it, which is
+         * the steady state of a replicated border. Inner loops run
+         * along a row, so they are vectorized by the compiler
+         */
+        void filter_strip(cv::Mat& plane, int x0, int x1, const Coefficients& c) {
+            const int rows = plane.rows;
+
+            for (int y = 0; y < rows; ++y) {
+                float* p = plane.ptr<float>(y);
+                const float* p1 = plane.ptr<float>(std::max(y - 1, 0));
+                const float* p2 = plane.ptr<float>(std::max(y - 2, 0));
+                const float* p3 = plane.ptr<float>(std::max(y - 3, 0));
+
+                for (int x = x0; x < x1; ++x) {
+                    p[x] = c.b * p[x] + c.a1 * p1[x] + c.a2 * p2[x] + c.a3 * p3[x];
+                }
+            }
+
+            for (int y = rows - 1; y >= 0; --y) {
+                float* p = plane.ptr<float>(y);
+                const float* p1 = plane.ptr<float>(std::min(y + 1, rows - 1));
+                const float* p2 = plane.ptr<float>(std::min(y + 2, rows - 1));
+                const float* p3 = plane.ptr<float>(std::min(y + 3, rows - 1));
+
+                for (int x = x0; x < x1; ++x) {
+                    p[x] = c.b * p[x] + c.a1 * p1[x] + c.a2 * p2[x] + c.a3 * p3[x];
+                }
+            }
+        }
+
+        // blurs columns in place, strips of them run in parallel
+        void filter_columns(cv::Mat& plane, const Coefficients& c) {
+            const int width = plane.cols * plane.channels();
+            const int strips = (width + strip_width - 1) / strip_width;
+
+            ThreadPool::instance().parallel_for(strips, [&](size_t i) {
+                int x0 = (int) i * strip_width;
+                filter_strip(plane, x0, std::min(x0 + strip_width, width), c);
+            });
+        }
+    }
+
+
+    cv::Mat recursive_blur(const cv::Mat& image, double sigma) {
+        CV_Assert(sigma >= 0.5);
+
+        const Coefficients c = young_van_vliet(sigma);
+
+        cv::Mat plane;
+        image.convertTo(plane, CV_32F);
+
+        // rows are blurred as columns of the transposed image,
+        // so both passes get the same vectorized loop
+        filter_columns(plane, c);
+
+        cv::Mat transposed;
+        cv::transpose(plane, transposed);
+        filter_columns(transposed, c);
+        cv::transpose(transposed, plane);
+
+        cv::Mat res;
+        plane.convertTo(res, image.depth());
+        return res;
+    }
+}
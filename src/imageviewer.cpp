@@ -1,4 +1,5 @@
 #include "../include/imageviewer.h"
+#include "../include/imageviewport.h"
 #include "algorithms.h"
 
 #include <QApplication>
@@ -7,7 +8,6 @@
 #include <QFileDialog>
 #include <QImageReader>
 #include <QImageWriter>
-#include <QLabel>
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QMimeData>
@@ -20,6 +20,8 @@
 #include <QToolBar>
 #include <QWheelEvent>
 
+#include <cmath>
+
 #if defined(QT_PRINTSUPPORT_LIB)
 
 #  include <QtPrintSupport/qtprintsupportglobal.h>
@@ -32,16 +34,14 @@
 #    include <QtWidgets/QInputDialog>
 #include <QtWidgets/QColorDialog>
 #include <QtWidgets/QSlider>
-#include <QtCore/QTimeLine>
 
 #  endif
 #endif
 
 ImageViewer::ImageViewer(QWidget *parent)
-        : QMainWindow(parent), imageLabel(new QLabel), scrollArea(new QScrollArea) {
-    imageLabel->setBackgroundRole(QPalette::Base);
-    imageLabel->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    imageLabel->setScaledContents(true);
+        : QMainWindow(parent), viewport(new ImageViewport(pyramid)), scrollArea(new QScrollArea) {
+    viewport->setBackgroundRole(QPalette::Base);
+    viewport->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
 
     /// dark theme
     // set style
@@ -79,20 +79,32 @@ ImageViewer::ImageViewer(QWidget *parent)
 
 
     scrollArea->setBackgroundRole(QPalette::Dark);
-    scrollArea->setWidget(imageLabel);
+    scrollArea->setWidget(viewport);
     scrollArea->setVisible(false);
     setCentralWidget(scrollArea);
 
     createActions();
 
+    connect(&renderWorker, &RenderWorker::rendered, this, &ImageViewer::previewRendered, Qt::QueuedConnection);
+    connect(&loadWorker, &RenderWorker::rendered, this, &ImageViewer::imageLoaded, Qt::QueuedConnection);
+    connect(&loadWorker, &RenderWorker::failed, this, &ImageViewer::loadFailed, Qt::QueuedConnection);
+    connect(&zoomAnimator, &ZoomAnimator::zoomed, this, &ImageViewer::zoomed);
+
     resize(QGuiApplication::primaryScreen()->availableSize() * 3 / 5);
 }
 
 bool ImageViewer::loadFile(const QString &fileName) {
+    // full decode of a file opened before is of no use anymore
+    loadWorker.cancel();
+
     QImageReader reader(fileName);
     reader.setAutoTransform(true);
 
-    cv::Mat new_image = cv::imread(fileName.toStdString());
+    if (reader.format() == "jpeg" && loadReduced(fileName, reader)) {
+        return true;
+    }
+
+    cv::Mat new_image = image_algorithms::read_image(fileName.toStdString());
     if (new_image.empty()) {
         QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
                                  tr("Cannot load %1: %2")
@@ -108,16 +120,113 @@ bool ImageViewer::loadFile(const QString &fileName) {
     setImage(new_image);
 
     scaleFactor = 1.0;
-    imageLabel->adjustSize();
+    viewport->resize(image.cols, image.rows);
     fitToWindow();
 
     return true;
 }
 
+bool ImageViewer::loadReduced(const QString &fileName, QImageReader &reader) {
+    // stored size, the decoders apply the EXIF orientation
+    QSize size = reader.size();
+    if (size.isEmpty()) {
+        return false;
+    }
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        size.transpose();
+    }
+
+    // coarsest decode that still has a pixel for every screen pixel once fitted
+    const QSize area = scrollArea->size();
+    double fit = std::min((double) (area.width() - 3) / size.width(),
+                          (double) (area.height() - 3) / size.height());
+
+    int factor = 8;
+    while (factor > 1 && fit * devicePixelRatioF() * factor > 1) {
+        factor /= 2;
+    }
+    if (factor == 1) {
+        return false;
+    }
+
+    const std::string path = fileName.toStdString();
+    cv::Mat reduced = image_algorithms::read_image_reduced(path, factor);
+    if (reduced.empty()) {
+        return false;
+    }
+
+    // fitted to the size that was actually decoded
+    const QSize full(reduced.cols * factor, reduced.rows * factor);
+    fit = std::min((double) (area.width() - 3) / full.width(), (double) (area.height() - 3) / full.height());
+
+    setWindowFilePath(fileName);
+    loadingFile = fileName;
+
+    // nothing can be edited until the full image is there
+    image = cv::Mat();
+    pyramid.reset(image);
+    updateActions();
+    printAct->setEnabled(false);
+    fitToWindowAct->setEnabled(false);
+    zoomInAct->setEnabled(false);
+    zoomOutAct->setEnabled(false);
+    normalSizeAct->setEnabled(false);
+
+    // shown stretched to the size of the full image, fitted to the window
+    stopZoom();
+    scaleFactor = fit;
+    viewport->showImage();
+    releasePreview();
+    viewport->showPreview(reduced);
+    viewport->resize(scaleFactor * full);
+    scrollArea->setVisible(true);
+
+    statusBar()->showMessage(tr("Loading %1 at full resolution...").arg(QDir::toNativeSeparators(fileName)));
+
+    loadWorker.post([path](const image_algorithms::Cancelled &) {
+        return image_algorithms::read_image(path);
+    });
+    return true;
+}
+
+void ImageViewer::imageLoaded(const cv::Mat &loaded, quint64 generation) {
+    // another file was opened meanwhile
+    if (generation != loadWorker.generation()) {
+        return;
+    }
+
+    controller.open_image(loaded);
+    setImage(loaded);
+    statusBar()->clearMessage();
+}
+
+void ImageViewer::loadFailed(quint64 generation) {
+    if (generation != loadWorker.generation()) {
+        return;
+    }
+
+    // reduced decode worked, the full one did not: nothing is open
+    viewport->showImage();
+    releasePreview();
+    scrollArea->setVisible(false);
+    setWindowFilePath(QString());
+    statusBar()->clearMessage();
+
+    QImageReader reader(loadingFile);
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                             tr("Cannot load %1: %2")
+                                     .arg(QDir::toNativeSeparators(loadingFile), reader.errorString()));
+}
+
 void ImageViewer::setImage(const cv::Mat &new_image) {
+    // a full decode still on the way would replace this image when done
+    loadWorker.cancel();
+
     image = new_image;
+    pyramid.reset(image);
 
-    imageLabel->setPixmap(cvMatToQPixmap(image));
+    viewport->showImage();
+    releasePreview();
     scaleImage(1);
 
     scrollArea->setVisible(true);
@@ -130,11 +239,61 @@ void ImageViewer::setImage(const cv::Mat &new_image) {
     updateActions();
 }
 
+cv::Size ImageViewer::displaySize() const {
+    QSize size = viewport->size() * viewport->devicePixelRatioF();
+    return cv::Size(size.width(), size.height());
+}
+
+void ImageViewer::preview(std::shared_ptr<const image_algorithms::Command> command) {
+    controller.update_preview(command);
+
+    // render only at the resolution the image is shown at,
+    // commands that depend on image size are scaled with it
+    auto proxy = pyramid.level(displaySize());
+    previewScale = proxy.scale;
+    if (auto scaled = command->scaled(proxy.scale)) {
+        command = scaled;
+    }
+
+    render(command, proxy.image);
+}
+
+void ImageViewer::render(std::shared_ptr<const image_algorithms::Command> command, const cv::Mat &source) {
+    // latest slider position wins, older renders stop at the next tile
+    renderWorker.post([this, command, source](const image_algorithms::Cancelled &cancelled) {
+        return controller.render_preview(command, source, cancelled);
+    });
+}
+
+void ImageViewer::previewRendered(const cv::Mat &preview, quint64 generation) {
+    // slider moved again or dialog was closed while it was on the way
+    if (generation == renderWorker.generation()) {
+        showPreview(preview);
+    } else {
+        controller.release_preview(preview);
+    }
+}
+
+void ImageViewer::showPreview(const cv::Mat &preview) {
+    // viewport keeps the size of the full resolution result
+    viewport->showPreview(preview);
+    viewport->resize(scaleFactor * QSize(preview.cols, preview.rows) / previewScale);
+
+    // the viewport does not read the last one anymore
+    releasePreview();
+    shownPreview = preview;
+}
+
+void ImageViewer::releasePreview() {
+    controller.release_preview(shownPreview);
+    shownPreview = cv::Mat();
+}
+
 
 bool ImageViewer::saveFile(const QString &fileName) {
     QImageWriter writer(fileName);
 
-    if (!imwrite(fileName.toStdString(), image)) {
+    if (!image_algorithms::write_image(fileName.toStdString(), image)) {
         QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
                                  tr("Cannot write %1: %2")
                                          .arg(QDir::toNativeSeparators(fileName)), writer.errorString());
@@ -169,18 +328,32 @@ void ImageViewer::saveAs() {
     while (!saveFile(fileName)) {}
 }
 
+void ImageViewer::saveRecipe() {
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Recipe As"),
+                                                    QString(),
+                                                    tr("Recipes (*.json *.yml *.xml *.gz)"));
+    if (fileName.isEmpty())
+        return;
+
+    if (!image_algorithms::write_recipe(fileName.toStdString(), controller.recipe())) {
+        QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                                 tr("Cannot write %1").arg(QDir::toNativeSeparators(fileName)));
+    }
+}
+
 void ImageViewer::print() {
-    Q_ASSERT(imageLabel->pixmap());
+    Q_ASSERT(!image.empty());
 #if defined(QT_PRINTSUPPORT_LIB) && QT_CONFIG(printdialog)
     QPrintDialog dialog(&printer, this);
     if (dialog.exec()) {
         QPainter painter(&printer);
         QRect rect = painter.viewport();
-        QSize size = imageLabel->pixmap()->size();
+        QImage printed = cvMatToQImage(image);
+        QSize size = printed.size();
         size.scale(rect.size(), Qt::KeepAspectRatio);
         painter.setViewport(rect.x(), rect.y(), size.width(), size.height());
-        painter.setWindow(imageLabel->pixmap()->rect());
-        painter.drawPixmap(0, 0, *imageLabel->pixmap());
+        painter.setWindow(printed.rect());
+        painter.drawImage(0, 0, printed);
     }
 #endif
 }
@@ -223,25 +396,29 @@ void ImageViewer::paste() {
 
 
 void ImageViewer::zoomIn() {
+    stopZoom();
     scaleImage(1.25);
 }
 
 void ImageViewer::zoomOut() {
+    stopZoom();
     scaleImage(0.8);
 }
 
 void ImageViewer::normalSize() {
-    imageLabel->adjustSize();
+    stopZoom();
+    viewport->resize(image.cols, image.rows);
     scaleFactor = 1.0;
 }
 
 void ImageViewer::fitToWindow() {
+    stopZoom();
     QSize size = scrollArea->size();
-    QSize label_size = imageLabel->size();
+    QSize viewport_size = viewport->size();
 
     // get factor to scale for
-    double factor = std::min((double) (size.width() - 3) / label_size.width(),
-                             (double) (size.height() - 3) / label_size.height());
+    double factor = std::min((double) (size.width() - 3) / viewport_size.width(),
+                             (double) (size.height() - 3) / viewport_size.height());
 
     scaleImage(factor);
 }
@@ -335,6 +512,9 @@ void ImageViewer::createActions() {
     saveAsAct = fileMenu->addAction(tr("&Save As..."), this, &ImageViewer::saveAs);
     saveAsAct->setEnabled(false);
 
+    saveRecipeAct = fileMenu->addAction(tr("Save &Recipe..."), this, &ImageViewer::saveRecipe);
+    saveRecipeAct->setEnabled(false);
+
     printAct = fileMenu->addAction(tr("&Print..."), this, &ImageViewer::print);
     printAct->setShortcut(QKeySequence::Print);
     printAct->setEnabled(false);
@@ -407,6 +587,7 @@ void ImageViewer::createActions() {
 
 void ImageViewer::updateActions() {
     saveAsAct->setEnabled(!image.empty());
+    saveRecipeAct->setEnabled(!image.empty());
     copyAct->setEnabled(!image.empty());
     uploadToImgurAct->setEnabled(!image.empty());
     cropAct->setEnabled(!image.empty());
@@ -415,10 +596,10 @@ void ImageViewer::updateActions() {
     brightenAct->setEnabled(!image.empty());
     saturationAct->setEnabled(!image.empty());
     contrastAct->setEnabled(!image.empty());
-    undoAct->setEnabled(controller.can_undo());
-    redoAct->setEnabled(controller.can_redo());
-    toolUndoAct->setEnabled(controller.can_undo());
-    toolRedoAct->setEnabled(controller.can_redo());
+    undoAct->setEnabled(!image.empty() && controller.can_undo());
+    redoAct->setEnabled(!image.empty() && controller.can_redo());
+    toolUndoAct->setEnabled(!image.empty() && controller.can_undo());
+    toolRedoAct->setEnabled(!image.empty() && controller.can_redo());
     toolCropAct->setEnabled(!image.empty());
     toolRotateAct->setEnabled(!image.empty());
     toolColorAct->setEnabled(!image.empty());
@@ -432,9 +613,11 @@ void ImageViewer::updateActions() {
 }
 
 void ImageViewer::scaleImage(double factor) {
-    Q_ASSERT(imageLabel->pixmap());
+    Q_ASSERT(!image.empty());
     scaleFactor *= factor;
-    imageLabel->resize(scaleFactor * imageLabel->pixmap()->size());
+
+    // viewport may show a downscaled preview
+    viewport->resize(scaleFactor * QSize(image.cols, image.rows));
 
     adjustScrollBar(scrollArea->horizontalScrollBar(), factor);
     adjustScrollBar(scrollArea->verticalScrollBar(), factor);
@@ -447,43 +630,48 @@ void ImageViewer::adjustScrollBar(QScrollBar *scrollBar, double factor) {
     scrollBar->setValue(int(factor * scrollBar->value() + ((factor - 1) * scrollBar->pageStep() / 2)));
 }
 
-void ImageViewer::animFinished() {
-    if (_numScheduledScalings > 0) _numScheduledScalings--;
-    else sender()->~QObject();
+void ImageViewer::stopZoom() {
+    zoomAnimator.stop();
+    viewport->setAnimating(false);
 }
 
-void ImageViewer::scalingTime(double x) {
-    scaleImage(tmpFactor);
+void ImageViewer::zoomed(double scale, bool settled) {
+    // frames in between are drawn fast, the last one at full quality
+    viewport->setAnimating(!settled);
+    scaleImage(scale / scaleFactor);
 }
 
 void ImageViewer::wheelEvent(QWheelEvent *event) {
-    if (event->modifiers().testFlag(Qt::ControlModifier)) {
-        _numScheduledScalings = 300;
-        if (event->delta() > 0) tmpFactor = pow(2.5, 1 / 300.0);
-        else tmpFactor = pow(2.5, -1 / 300.0);
-
-        auto *anim = new QTimeLine(350, this);
-        anim->setUpdateInterval(20);
-
-        connect(anim, SIGNAL(valueChanged(qreal)), SLOT(scalingTime(qreal)));
-        connect(anim, SIGNAL(finished()), SLOT(animFinished()));
-        anim->start();
+    if (event->modifiers().testFlag(Qt::ControlModifier) && !image.empty()) {
+        // 2.5x per notch, fine-grained wheels send parts of one
+        const double notches = event->angleDelta().y() / 120.0;
+        zoomAnimator.zoomBy(std::pow(2.5, notches), scaleFactor);
     }
 }
 
 void ImageViewer::undo() {
-    setImage(controller.undo());
+    cv::Mat undone = controller.undo();
+    if (undone.empty()) {
+        statusBar()->showMessage(tr("Cannot read the previous version back from disk"));
+        return;
+    }
+    setImage(undone);
 }
 
 void ImageViewer::redo() {
-    setImage(controller.redo());
+    cv::Mat redone = controller.redo();
+    if (redone.empty()) {
+        statusBar()->showMessage(tr("Cannot read the next version back from disk"));
+        return;
+    }
+    setImage(redone);
 }
 
 void ImageViewer::crop() {
-    int x = QInputDialog::getInt(this, tr("Crop"), tr("x:"), 0, 0, image.cols);
-    int y = QInputDialog::getInt(this, tr("Crop"), tr("y:"), 0, 0, image.rows);
-    int w = QInputDialog::getInt(this, tr("Crop"), tr("width:"), 0, 0, image.cols - x);
-    int h = QInputDialog::getInt(this, tr("Crop"), tr("height:"), 0, 0, image.rows - y);
+    int x = QInputDialog::getInt(this, tr("Crop"), tr("x:"), 0, 0, image.cols - 1);
+    int y = QInputDialog::getInt(this, tr("Crop"), tr("y:"), 0, 0, image.rows - 1);
+    int w = QInputDialog::getInt(this, tr("Crop"), tr("width:"), image.cols - x, 1, image.cols - x);
+    int h = QInputDialog::getInt(this, tr("Crop"), tr("height:"), image.rows - y, 1, image.rows - y);
     setImage(controller.crop(image, w, h, x, y));
 }
 
@@ -493,14 +681,29 @@ void ImageViewer::applyBright() {
 }
 
 void ImageViewer::cancel() {
-    setImage(oldImage);
-    window->close();
+    renderWorker.cancel();
+    if (controller.in_preview()) {
+        setImage(controller.rollback_preview());
+    }
+}
+
+void ImageViewer::applyPreview() {
+    renderWorker.cancel();
+
+    // the only full resolution render of the dialog
+    setImage(controller.commit_preview());
+    window->accept();
 }
 
 void ImageViewer::blend(int ratio) {
-    auto im = croppedOldImage;
     double alpha = (double) ratio / 50;
-    setImage(controller.blend(blendImage, im, alpha));
+    controller.update_preview(std::make_shared<image_algorithms::Blend>(blendImage, 1 - alpha));
+
+    // blend image is taken at the same scale as the proxy
+    auto proxy = pyramid.level(displaySize());
+    auto blendProxy = blendPyramid.level(proxy.scale);
+    previewScale = proxy.scale;
+    render(std::make_shared<image_algorithms::Blend>(blendProxy.image, 1 - alpha), proxy.image);
 }
 
 void ImageViewer::applyBlend() {
@@ -515,7 +718,7 @@ void ImageViewer::applyBlend() {
 
     QImageReader reader(path);
     reader.setAutoTransform(true);
-    blendImage = cv::imread(path.toStdString());
+    blendImage = image_algorithms::read_image(path.toStdString());
     if (blendImage.empty()) {
         QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
                                  tr("Cannot load %1: %2")
@@ -523,12 +726,9 @@ void ImageViewer::applyBlend() {
         return;
     }
 
-    int x = std::min(image.cols, blendImage.cols);
-    int y = std::min(image.rows, blendImage.rows);
-    oldImage = image;
-    image = controller.crop(image, x, y, 0, 0);
-    blendImage = controller.crop(blendImage, x, y, 0, 0);
-    croppedOldImage = image;
+    // blend crops both images to their common part itself
+    controller.begin_preview(image);
+    blendPyramid.reset(blendImage);
 
     auto *slider = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
@@ -543,18 +743,18 @@ void ImageViewer::applyBlend() {
     window->setWindowTitle(tr("Blend"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(slider, &QSlider::valueChanged, this, &ImageViewer::blend);
     }
 
 void ImageViewer::saturate(int ratio) {
-    auto im = oldImage;
-    setImage(controller.saturate(im, ratio));
+    preview(std::make_shared<image_algorithms::Saturate>(ratio));
 }
 
 void ImageViewer::applySaturation() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *slider = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -568,18 +768,18 @@ void ImageViewer::applySaturation() {
     window->setWindowTitle(tr("Saturation"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(slider, &QSlider::valueChanged, this, &ImageViewer::saturate);
 }
 
 void ImageViewer::lighten(int ratio) {
-    auto im = oldImage;
-    setImage(controller.lighten(im, ratio));
+    preview(std::make_shared<image_algorithms::Lighten>(ratio));
 }
 
 void ImageViewer::applyLight() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *slider = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -593,18 +793,18 @@ void ImageViewer::applyLight() {
     window->setWindowTitle(tr("Light"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(slider, &QSlider::valueChanged, this, &ImageViewer::lighten);
 }
 
 void ImageViewer::hue(int ratio) {
-    auto im = oldImage;
-    setImage(controller.hue(im, ratio));
+    preview(std::make_shared<image_algorithms::Hue>(ratio));
 }
 
 void ImageViewer::applyHue() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *slider = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -618,8 +818,9 @@ void ImageViewer::applyHue() {
     window->setWindowTitle(tr("Hue"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(slider, &QSlider::valueChanged, this, &ImageViewer::hue);
 }
 
@@ -659,12 +860,11 @@ void ImageViewer::applyTint() {
 
 
 void ImageViewer::temperature(int ratio) {
-    auto im = oldImage;
-    setImage(controller.temperature(im, ratio));
+    preview(std::make_shared<image_algorithms::Temperature>(ratio));
 }
 
 void ImageViewer::applyTemperature() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *slider = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -678,19 +878,19 @@ void ImageViewer::applyTemperature() {
     window->setWindowTitle(tr("Temperature"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(slider, &QSlider::valueChanged, this, &ImageViewer::temperature);
 }
 
 void ImageViewer::blur(int ratio) {
-    auto im = oldImage;
     double degree = (double) ratio / -10;
-    setImage(controller.sharpen(im, degree));
+    preview(std::make_shared<image_algorithms::Sharpen>(degree));
 }
 
 void ImageViewer::applyBlur() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *sliderBlur = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -704,19 +904,20 @@ void ImageViewer::applyBlur() {
     window->setWindowTitle(tr("Blur"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(sliderBlur, &QSlider::valueChanged, this, &ImageViewer::blur);
 }
 
 void ImageViewer::sharp(int ratio) {
-    auto im = oldImage;
     double degree = (double) ratio / 10;
-    setImage(controller.sharpen(im, degree));
+    // detail of brightness is enough, a third of the work
+    preview(std::make_shared<image_algorithms::Sharpen>(degree, 3, 0, true));
 }
 
 void ImageViewer::applySharp() {
-    oldImage = image;
+    controller.begin_preview(image);
     auto *sliderSharpness = new QSlider(Qt::Horizontal);
     auto *applyButton= new QPushButton("Apply");
     auto *cancelButton= new QPushButton("Cancel");
@@ -730,8 +931,9 @@ void ImageViewer::applySharp() {
     window->setWindowTitle(tr("Sharpness"));
     window->setLayout(layout);
     window->show();
-    connect(applyButton, SIGNAL(clicked()), window, SLOT(close()));
-    connect(cancelButton, SIGNAL(clicked()), this, SLOT(cancel()));
+    connect(applyButton, SIGNAL(clicked()), this, SLOT(applyPreview()));
+    connect(cancelButton, SIGNAL(clicked()), window, SLOT(reject()));
+    connect(window, SIGNAL(rejected()), this, SLOT(cancel()));
     connect(sliderSharpness, &QSlider::valueChanged, this, &ImageViewer::sharp);
 }
 
@@ -0,0 +1,168 @@
+#include "../include/imageviewport.h"
+
+#include <QElapsedTimer>
+#include <QPaintEvent>
+#include <QPainter>
+
+#include <cmath>
+
+namespace {
+
+    // tiles of different levels differ in the width of their level
+    quint64 tileKey(int levelWidth, int tx, int ty) {
+        return ((quint64) levelWidth << 40) | ((quint64) ty << 20) | (quint64) tx;
+    }
+
+    // widget coordinate on the nearest device pixel
+    double snap(double value, double dpr) {
+        return std::round(value * dpr) / dpr;
+    }
+}
+
+
+ImageViewport::ImageViewport(image_algorithms::PreviewPyramid &pyramid, QWidget *parent)
+        : QWidget(parent), pyramid{pyramid} {
+    // every exposed pixel is covered by the image
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void ImageViewport::showImage() {
+    preview.clear();
+    clearTiles();
+    overviewImage = QImage();
+
+    fullSize = pyramid.level(1.0).image.size();
+    update();
+}
+
+void ImageViewport::showPreview(const cv::Mat &new_preview) {
+    // converted when painted, only the part in view
+    preview.reset(new_preview);
+    update();
+}
+
+void ImageViewport::setAnimating(bool value) {
+    if (animating != value) {
+        animating = value;
+        update();
+    }
+}
+
+void ImageViewport::clearTiles() {
+    tiles.clear();
+    tileIndex.clear();
+    tileBytes = 0;
+}
+
+void ImageViewport::paintEvent(QPaintEvent *event) {
+    QElapsedTimer clock;
+    clock.start();
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, !animating);
+
+    const QRect exposed = event->rect();
+    if (!preview.empty()) {
+        paintPreview(painter, exposed);
+        return;
+    }
+    if (fullSize.empty() || width() <= 0 || height() <= 0) {
+        return;
+    }
+
+    // smallest level that still has a pixel for every screen pixel
+    const double dpr = devicePixelRatioF();
+    const double zoom = (double) width() / fullSize.width;
+    const image_algorithms::Proxy level = pyramid.level(zoom * dpr);
+    const cv::Size levelSize = level.image.size();
+
+    // pixels of level per pixel of widget
+    const double sx = (double) levelSize.width / width();
+    const double sy = (double) levelSize.height / height();
+
+    const int tx0 = std::max(0, (int) std::floor(exposed.left() * sx) / tileSize);
+    const int ty0 = std::max(0, (int) std::floor(exposed.top() * sy) / tileSize);
+    const int tx1 = std::min((levelSize.width - 1) / tileSize, (int) std::ceil((exposed.right() + 1) * sx) / tileSize);
+    const int ty1 = std::min((levelSize.height - 1) / tileSize, (int) std::ceil((exposed.bottom() + 1) * sy) / tileSize);
+
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            const bool convert = !animating || clock.elapsed() < frameBudgetMs;
+            const int w = std::min(tileSize, levelSize.width - tx * tileSize);
+            const int h = std::min(tileSize, levelSize.height - ty * tileSize);
+
+            // edges on device pixels, neighbours share them, so no seams show between tiles
+            const double left = snap(tx * tileSize / sx, dpr), top = snap(ty * tileSize / sy, dpr);
+            const double right = snap((tx * tileSize + w) / sx, dpr), bottom = snap((ty * tileSize + h) / sy, dpr);
+            QRectF target(left, top, right - left, bottom - top);
+
+            if (const QImage *image = tile(level, tx, ty, convert)) {
+                painter.drawImage(target, *image, QRectF(0, 0, w, h));
+            } else {
+                // the same part of the image, coarser
+                const QImage &small = overview();
+                const double ox = (double) small.width() / width(), oy = (double) small.height() / height();
+                QRectF source(target.x() * ox, target.y() * oy, target.width() * ox, target.height() * oy);
+                painter.drawImage(target, small, source);
+            }
+        }
+    }
+}
+
+void ImageViewport::paintPreview(QPainter &painter, const QRect &exposed) {
+    // preview is rendered at about the size it is shown at, no tiles needed
+    const cv::Size size = preview.size();
+    const double sx = (double) size.width / width();
+    const double sy = (double) size.height / height();
+
+    QRectF source(exposed.x() * sx, exposed.y() * sy, exposed.width() * sx, exposed.height() * sy);
+
+    // one more pixel around for smooth scaling at the edges
+    QRect pixels = source.toAlignedRect();
+    const QImage &image = preview.prepare(cv::Rect(pixels.x() - 1, pixels.y() - 1, pixels.width() + 2, pixels.height() + 2));
+    painter.drawImage(QRectF(exposed), image, source);
+}
+
+const QImage *ImageViewport::tile(const image_algorithms::Proxy &level, int tx, int ty, bool convert) {
+    const quint64 key = tileKey(level.image.cols, tx, ty);
+
+    auto it = tileIndex.find(key);
+    if (it != tileIndex.end()) {
+        tiles.splice(tiles.begin(), tiles, it->second);
+        return &tiles.front().image;
+    }
+    if (!convert) {
+        return nullptr;
+    }
+
+    cv::Rect rect(tx * tileSize, ty * tileSize, tileSize, tileSize);
+    cv::Mat pixels = level.image(rect & cv::Rect(cv::Point(), level.image.size()));
+
+    // converted once straight into the format it is drawn from
+    QImage image(pixels.cols, pixels.rows, displayFormat(pixels.type()));
+    convertForDisplay(pixels, image, cv::Point());
+
+    tileBytes += (size_t) image.bytesPerLine() * image.height();
+    tiles.push_front({key, std::move(image)});
+    tileIndex.emplace(key, tiles.begin());
+
+    while (tileBytes > tileBudget && tiles.size() > 1) {
+        const QImage &last = tiles.back().image;
+        tileBytes -= (size_t) last.bytesPerLine() * last.height();
+        tileIndex.erase(tiles.back().key);
+        tiles.pop_back();
+    }
+
+    return &tiles.front().image;
+}
+
+const QImage &ImageViewport::overview() {
+    if (overviewImage.isNull()) {
+        double scale = std::min(1.0, (double) overviewSize / std::max(fullSize.width, fullSize.height));
+        cv::Mat pixels = pyramid.level(scale).image;
+
+        overviewImage = QImage(pixels.cols, pixels.rows, displayFormat(pixels.type()));
+        convertForDisplay(pixels, overviewImage, cv::Point());
+    }
+    return overviewImage;
+}
@@ -0,0 +1,160 @@
+#include "../include/lut.h"
+
+namespace image_algorithms {
+
+    namespace {
+
+        void clamp_colors(cv::Mat& colors) {
+            auto* p = colors.ptr<float>();
+            size_t n = colors.total() * colors.channels();
+
+            for (size_t i = 0; i < n; ++i) {
+                p[i] = std::min(std::max(p[i], 0.f), 1.f);
+            }
+        }
+
+        class TetrahedralBody : public cv::ParallelLoopBody {
+        private:
+            const cv::Mat& src;
+            cv::Mat& dst;
+            const cv::Mat& table;
+            int size;
+            // lattice cell and position inside it for every 8-bit value
+            int index[256];
+            float frac[256];
+
+        public:
+            TetrahedralBody(const cv::Mat& src, cv::Mat& dst, const cv::Mat& table, int size)
+                    : src{src}, dst{dst}, table{table}, size{size} {
+                for (int v = 0; v < 256; ++v) {
+                    float pos = v * (size - 1) / 255.f;
+                    index[v] = std::min((int) pos, size - 2);
+                    frac[v] = pos - index[v];
+                }
+            }
+
+            void operator()(const cv::Range& range) const override {
+                const float* t = table.ptr<float>();
+                const int sb = 3, sg = 3 * size, sr = 3 * size * size;
+
+                for (int y = range.start; y < range.end; ++y) {
+                    const uchar* s = src.ptr<uchar>(y);
+                    uchar* d = dst.ptr<uchar>(y);
+
+                    for (int x = 0; x < src.cols; ++x) {
+                        int b = s[3 * x], g = s[3 * x + 1], r = s[3 * x + 2];
+                        float fb = frac[b], fg = frac[g], fr = frac[r];
+
+                        const float* c000 = t + index[b] * sb + index[g] * sg + index[r] * sr;
+                        const float* c111 = c000 + sb + sg + sr;
+
+                        // walk from c000 to c111 along the axes sorted by fraction,
+                        // the four visited corners form the tetrahedron with the point
+                        const float* p1;
+                        const float* p2;
+                        float w1, w2, w3;
+
+                        if (fb >= fg) {
+                            if (fg >= fr) {
+                                p1 = c000 + sb; p2 = c000 + sb + sg;
+                                w1 = fb; w2 = fg; w3 = fr;
+                            } else if (fb >= fr) {
+                                p1 = c000 + sb; p2 = c000 + sb + sr;
+                                w1 = fb; w2 = fr; w3 = fg;
+                            } else {
+                                p1 = c000 + sr; p2 = c000 + sb + sr;
+                                w1 = fr; w2 = fb; w3 = fg;
+                            }
+                        } else {
+                            if (fr >= fg) {
+                                p1 = c000 + sr; p2 = c000 + sg + sr;
+                                w1 = fr; w2 = fg; w3 = fb;
+                            } else if (fr >= fb) {
+                                p1 = c000 + sg; p2 = c000 + sg + sr;
+                                w1 = fg; w2 = fr; w3 = fb;
+                            } else {
+                                p1 = c000 + sg; p2 = c000 + sb + sg;
+                                w1 = fg; w2 = fb; w3 = fr;
+                            }
+                        }
+
+                        for (int c = 0; c < 3; ++c) {
+                            float v = c000[c] + w1 * (p1[c] - c000[c]) + w2 * (p2[c] - p1[c]) +
+                                      w3 * (c111[c] - p2[c]);
+
+                            // convex combination of entries in [0, 255]
+                            d[3 * x + c] = static_cast<uchar>(v + 0.5f);
+                        }
+                    }
+                }
+            }
+        };
+    }
+
+
+    Lut3D::Lut3D(std::vector<std::shared_ptr<const Command>> commands, int size)
+            : size{size}, commands{std::move(commands)} {
+        CV_Assert(size >= 2);
+
+        // identity lattice
+        cv::Mat colors(1, size * size * size, CV_32FC3);
+        auto* p = colors.ptr<float>();
+
+        for (int r = 0; r < size; ++r) {
+            for (int g = 0; g < size; ++g) {
+                for (int b = 0; b < size; ++b) {
+                    int i = (r * size + g) * size + b;
+                    p[3 * i] = b / (size - 1.f);
+                    p[3 * i + 1] = g / (size - 1.f);
+                    p[3 * i + 2] = r / (size - 1.f);
+                }
+            }
+        }
+
+        // every command saturates its 8-bit result, so clamp after each one
+        for (const auto& command : this->commands) {
+            CV_Assert(command->is_color_op());
+            command->apply_to_colors(colors);
+            clamp_colors(colors);
+        }
+
+        table = colors * 255;
+    }
+
+    cv::Mat Lut3D::execute(const cv::Mat& image) const {
+        cv::Mat res;
+        execute_into(image, res);
+        return res;
+    }
+
+    void Lut3D::execute_into(const cv::Mat& image, cv::Mat& dst) const {
+        if (image.type() != CV_8UC3) {
+            cv::Mat res = image;
+            for (const auto& command : commands) {
+                res = command->execute(res);
+            }
+            dst = res;
+            return;
+        }
+
+        dst.create(image.size(), image.type());
+
+        cv::parallel_for_(cv::Range(0, image.rows), TetrahedralBody(image, dst, table, size),
+                          (double) image.total() / (1 << 16));
+    }
+
+    bool Lut3D::in_place() const {
+        return true;
+    }
+
+    bool Lut3D::is_color_op() const {
+        return true;
+    }
+
+    void Lut3D::apply_to_colors(cv::Mat& colors) const {
+        for (const auto& command : commands) {
+            command->apply_to_colors(colors);
+            clamp_colors(colors);
+        }
+    }
+}
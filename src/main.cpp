@@ -1,9 +1,127 @@
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QDir>
 
+#include "../include/batch.h"
+#include "../include/bufferpool.h"
 #include "../include/imageviewer.h"
 
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+    void printStage(const char *name, double seconds, size_t images) {
+        std::cout << "  " << name << seconds << " s busy, "
+                  << (images ? seconds * 1000 / images : 0) << " ms/image" << std::endl;
+    }
+
+    int runBatch() {
+        QCommandLineParser parser;
+        parser.setApplicationDescription("Applies an edit recipe to images without opening a window.");
+        parser.addHelpOption();
+
+        const QString workers = QString::number(std::max(1u, std::thread::hardware_concurrency() / 2));
+
+        QCommandLineOption batchOption("batch", "Process files without GUI.");
+        QCommandLineOption recipeOption("recipe", "Edits to apply, e.g. brighten=20,saturate=40,blur=2, or a recipe file.", "recipe");
+        QCommandLineOption outputOption("output", "Directory to write results to.", "dir");
+        QCommandLineOption formatOption("format", "Extension of the results, the input one by default.", "ext");
+        QCommandLineOption listOption("input-list", "File with an input path per line.", "file");
+        QCommandLineOption workersOption("workers", "Threads of every stage.", "n", workers);
+        QCommandLineOption queueOption("queue", "Images waiting between two stages.", "n", "8");
+        QCommandLineOption prefaultOption("prefault", "Fault in pages of new image buffers right away.");
+        QCommandLineOption linearOption("linear", "Apply color adjustments in linear light.");
+        parser.addOptions({batchOption, recipeOption, outputOption, formatOption, listOption, workersOption,
+                           queueOption, prefaultOption, linearOption});
+        parser.addPositionalArgument("files", "Input files or glob patterns.", "[files...]");
+        parser.process(QCoreApplication::arguments());
+
+        if (parser.isSet(prefaultOption)) {
+            image_algorithms::BufferPoolPolicy policy;
+            policy.prefault = true;
+            image_algorithms::BufferPool::instance().set_policy(policy);
+        }
+
+        batch::Options options;
+        std::string error;
+        if (!batch::parse_recipe(parser.value(recipeOption).toStdString(), options.recipe, error)) {
+            std::cerr << "Bad recipe: " << error << std::endl;
+            return 1;
+        }
+
+        options.output_dir = parser.value(outputOption).toStdString();
+        if (options.output_dir.empty() || !QDir().mkpath(parser.value(outputOption))) {
+            std::cerr << "Output directory is required" << std::endl;
+            return 1;
+        }
+
+        std::vector<std::string> inputs;
+        for (const auto &file : parser.positionalArguments()) {
+            inputs.push_back(file.toStdString());
+        }
+        if (parser.isSet(listOption)) {
+            std::ifstream list(parser.value(listOption).toStdString());
+            for (std::string line; std::getline(list, line);) {
+                if (!line.empty()) {
+                    inputs.push_back(line);
+                }
+            }
+        }
+
+        options.inputs = batch::expand_inputs(inputs);
+        options.format = parser.value(formatOption).toStdString();
+        options.linear_light = parser.isSet(linearOption);
+
+        bool workersOk, queueOk;
+        options.workers = parser.value(workersOption).toInt(&workersOk);
+        const int queue = parser.value(queueOption).toInt(&queueOk);
+        if (!workersOk || options.workers < 1 || !queueOk || queue < 1) {
+            std::cerr << "--workers and --queue take a positive number" << std::endl;
+            return 1;
+        }
+        options.queue_size = queue;
+
+        std::vector<std::string> outputs;
+        if (!batch::output_paths(options, outputs, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        batch::Report report = batch::run(options);
+        for (const auto &failure : report.errors) {
+            std::cerr << failure << std::endl;
+        }
+
+        std::cout << "Processed " << report.done << " image(s), " << report.failed << " failed in "
+                  << report.seconds << " s, " << (report.seconds > 0 ? report.done / report.seconds : 0)
+                  << " images/s" << std::endl;
+        size_t images = report.done + report.failed;
+        printStage("decode:  ", report.decode_seconds, images);
+        printStage("process: ", report.process_seconds, images);
+        printStage("encode:  ", report.encode_seconds, images);
+
+        auto buffers = image_algorithms::BufferPool::instance().stats();
+        std::cout << "  buffers: " << buffers.hits << " reused, " << buffers.misses << " mapped, "
+                  << (buffers.peak >> 20) << " MB at peak" << std::endl;
+
+        return report.failed == 0 ? 0 : 2;
+    }
+}
+
 int main(int argc, char *argv[]) {
+    // image temporaries of the same size come back from the pool
+    image_algorithms::BufferPool::instance().install();
+
+    // no window in batch mode, so no QApplication either
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            QCoreApplication app(argc, argv);
+            return runBatch();
+        }
+    }
+
     QApplication app(argc, argv);
     QGuiApplication::setApplicationDisplayName(ImageViewer::tr("Photoeditor"));
     QCommandLineParser commandLineParser;
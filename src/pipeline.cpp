@@ -0,0 +1,512 @@
+#include "../include/pipeline.h"
+#include "../include/lut.h"
+#include "../include/tiles.h"
+#include "../include/warp.h"
+
+#include <cmath>
+#include <limits>
+
+namespace image_algorithms {
+
+    PointOp PointOp::affine(const cv::Matx34f& matrix) {
+        PointOp op;
+        op.kind = Kind::Affine;
+        op.matrix = matrix;
+        return op;
+    }
+
+    PointOp PointOp::value(float shift) {
+        PointOp op;
+        op.kind = Kind::Value;
+        op.shift = shift;
+        return op;
+    }
+
+    bool PointOp::keeps_gray() const {
+        if (kind == Kind::Value) {
+            return true;
+        }
+
+        // every channel of a gray pixel must get the same value
+        const cv::Matx34f& m = matrix;
+        for (int i = 1; i < 3; ++i) {
+            if (std::abs(m(i, 0) + m(i, 1) + m(i, 2) - (m(0, 0) + m(0, 1) + m(0, 2))) > 1e-6f ||
+                m(i, 3) != m(0, 3)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool PointOp::makes_gray() const {
+        if (kind == Kind::Value) {
+            return false;
+        }
+
+        for (int i = 1; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                if (std::abs(matrix(i, j) - matrix(0, j)) > 1e-6f) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    PointOp PointOp::then(const PointOp& next) const {
+        CV_Assert(kind == Kind::Affine && next.kind == Kind::Affine);
+
+        // next * this on homogeneous colors
+        cv::Matx34f res;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                float v = j == 3 ? next.matrix(i, 3) : 0.f;
+                for (int k = 0; k < 3; ++k) {
+                    v += next.matrix(i, k) * matrix(k, j);
+                }
+                res(i, j) = v;
+            }
+        }
+        return affine(res);
+    }
+
+
+    namespace {
+
+        inline float clamp_255(float v) {
+            return std::min(std::max(v, 0.f), 255.f);
+        }
+
+        // Channels of a row are kept as three planar float arrays,
+        // so inner loops are branch-free and get vectorized by the compiler
+        void apply(const PointOp& op, float* b, float* g, float* r, int n) {
+            if (op.kind == PointOp::Kind::Affine) {
+                const cv::Matx34f& m = op.matrix;
+                const float m00 = m(0, 0), m01 = m(0, 1), m02 = m(0, 2), m03 = m(0, 3);
+                const float m10 = m(1, 0), m11 = m(1, 1), m12 = m(1, 2), m13 = m(1, 3);
+                const float m20 = m(2, 0), m21 = m(2, 1), m22 = m(2, 2), m23 = m(2, 3);
+
+                for (int x = 0; x < n; ++x) {
+                    float b0 = b[x], g0 = g[x], r0 = r[x];
+
+                    // every command saturates its 8-bit result,
+                    // so clamp after each op as well
+                    b[x] = clamp_255(m00 * b0 + m01 * g0 + m02 * r0 + m03);
+                    g[x] = clamp_255(m10 * b0 + m11 * g0 + m12 * r0 + m13);
+                    r[x] = clamp_255(m20 * b0 + m21 * g0 + m22 * r0 + m23);
+                }
+            } else {
+                const float shift = op.shift;
+
+                for (int x = 0; x < n; ++x) {
+                    float v = std::max(b[x], std::max(g[x], r[x]));
+                    float new_v = clamp_255(v + shift);
+
+                    // with fixed hue and saturation all channels scale with value,
+                    // black pixels have no saturation and become gray
+                    float scale = v > 0 ? new_v / v : 0.f;
+                    float base = v > 0 ? 0.f : new_v;
+
+                    b[x] = b[x] * scale + base;
+                    g[x] = g[x] * scale + base;
+                    r[x] = r[x] * scale + base;
+                }
+            }
+        }
+
+        // gray pixels through an op that keeps them gray, see PointOp::keeps_gray()
+        void apply_gray(const PointOp& op, float* v, int n) {
+            if (op.kind == PointOp::Kind::Affine) {
+                const cv::Matx34f& m = op.matrix;
+                const float scale = m(0, 0) + m(0, 1) + m(0, 2), shift = m(0, 3);
+
+                for (int x = 0; x < n; ++x) {
+                    v[x] = clamp_255(scale * v[x] + shift);
+                }
+            } else {
+                // value of a gray pixel is the pixel itself
+                const float shift = op.shift;
+
+                for (int x = 0; x < n; ++x) {
+                    v[x] = clamp_255(v[x] + shift);
+                }
+            }
+        }
+
+        // sRGB value in [0, 1] to linear light and back
+        float srgb_to_linear(float v) {
+            return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+
+        float linear_to_srgb(float v) {
+            return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1 / 2.4f) - 0.055f;
+        }
+
+        // linear light of every value of T, in [0, 255]
+        template<typename T>
+        const std::vector<float>& decode_table() {
+            static const std::vector<float> table = []() {
+                const int size = std::numeric_limits<T>::max() + 1;
+                std::vector<float> res(size);
+                for (int i = 0; i < size; ++i) {
+                    res[i] = 255 * srgb_to_linear((float) i / (size - 1));
+                }
+                return res;
+            }();
+            return table;
+        }
+
+        // sRGB of linear light in [0, 255], interpolated between encode_steps points
+        const int encode_steps = 4096;
+
+        const std::vector<float>& encode_table() {
+            static const std::vector<float> table = []() {
+                std::vector<float> res(encode_steps + 2);
+                for (int i = 0; i <= encode_steps; ++i) {
+                    res[i] = 255 * linear_to_srgb((float) i / encode_steps);
+                }
+                res[encode_steps + 1] = res[encode_steps];
+                return res;
+            }();
+            return table;
+        }
+
+        inline float encode(const float* table, float v) {
+            float pos = v * (encode_steps / 255.f);
+            int i = (int) pos;
+            return table[i] + (pos - i) * (table[i + 1] - table[i]);
+        }
+
+        /**
+         * Kernel of apply_point_ops for channel type T and cn channels
+         *
+         * Ops are written for [0, 255], wider types are scaled
+         * into that range as floats, so they keep their precision.
+         * gray_out writes only the first channel of a 3-channel
+         * source, for ops that leave nothing but gray
+         */
+        template<typename T, int cn>
+        class FusedBody : public cv::ParallelLoopBody {
+        private:
+            const cv::Mat& src;
+            cv::Mat& dst;
+            const std::vector<PointOp>& ops;
+            bool gray_out;
+            const float* decode = nullptr;
+            const float* encode_lut = nullptr;
+
+        public:
+            FusedBody(const cv::Mat& src, cv::Mat& dst, const std::vector<PointOp>& ops, bool gray_out,
+                      bool linear_light)
+                    : src{src}, dst{dst}, ops{ops}, gray_out{gray_out} {
+                if (linear_light) {
+                    decode = decode_table<T>().data();
+                    encode_lut = encode_table().data();
+                }
+            }
+
+            void operator()(const cv::Range& range) const override {
+                const float to_255 = 255.f / std::numeric_limits<T>::max();
+                const float from_255 = 1 / to_255;
+
+                const int n = src.cols;
+                std::vector<float> buffer((cn == 1 ? 1 : 3) * n);
+                float* b = buffer.data();
+                float* g = b + n;
+                float* r = g + n;
+                const int planes = cn == 1 ? 1 : 3;
+
+                for (int y = range.start; y < range.end; ++y) {
+                    const T* s = src.ptr<T>(y);
+                    T* d = dst.ptr<T>(y);
+
+                    for (int c = 0; c < planes; ++c) {
+                        float* p = b + c * n;
+                        if (decode) {
+                            for (int x = 0; x < n; ++x) {
+                                p[x] = decode[s[cn * x + c]];
+                            }
+                        } else {
+                            for (int x = 0; x < n; ++x) {
+                                p[x] = s[cn * x + c] * to_255;
+                            }
+                        }
+                    }
+
+                    for (const auto& op : ops) {
+                        if (cn == 1) {
+                            apply_gray(op, b, n);
+                        } else {
+                            apply(op, b, g, r, n);
+                        }
+                    }
+
+                    if (encode_lut) {
+                        for (int i = 0; i < planes * n; ++i) {
+                            b[i] = encode(encode_lut, b[i]);
+                        }
+                    }
+
+                    // values are already in [0, 255], alpha is kept
+                    if (cn == 1 || gray_out) {
+                        for (int x = 0; x < n; ++x) {
+                            d[x] = static_cast<T>(b[x] * from_255 + 0.5f);
+                        }
+                        continue;
+                    }
+
+                    for (int x = 0; x < n; ++x) {
+                        d[cn * x] = static_cast<T>(b[x] * from_255 + 0.5f);
+                        d[cn * x + 1] = static_cast<T>(g[x] * from_255 + 0.5f);
+                        d[cn * x + 2] = static_cast<T>(r[x] * from_255 + 0.5f);
+                        if (cn == 4) {
+                            d[cn * x + 3] = s[cn * x + 3];
+                        }
+                    }
+                }
+            }
+        };
+
+        template<typename T>
+        void run_fused(const std::vector<PointOp>& ops, const cv::Mat& src, cv::Mat& dst, bool gray_out,
+                       bool linear_light) {
+            // stripes of about 64K pixels
+            const cv::Range rows(0, src.rows);
+            const double stripes = (double) src.total() / (1 << 16);
+
+            switch (src.channels()) {
+                case 1:
+                    cv::parallel_for_(rows, FusedBody<T, 1>(src, dst, ops, false, linear_light), stripes);
+                    break;
+                case 3:
+                    cv::parallel_for_(rows, FusedBody<T, 3>(src, dst, ops, gray_out, linear_light), stripes);
+                    break;
+                default:
+                    cv::parallel_for_(rows, FusedBody<T, 4>(src, dst, ops, false, linear_light), stripes);
+            }
+        }
+
+        /**
+         * A single affine op as one cv::transform (a convertTo for gray),
+         * which OpenCV runs as a fixed-point SIMD pass on 8-bit images
+         */
+        void transform_affine(const cv::Matx34f& m, const cv::Mat& src, cv::Mat& dst, bool gray_out) {
+            // offsets are given for [0, 255]
+            const float range = src.depth() == CV_8U ? 1.f : 257.f;
+            const int cn = src.channels();
+
+            if (cn == 1) {
+                src.convertTo(dst, -1, m(0, 0) + m(0, 1) + m(0, 2), m(0, 3) * range);
+                return;
+            }
+
+            const int rows = gray_out ? 1 : cn;
+            cv::Mat t = cv::Mat::zeros(rows, cn + 1, CV_32F);
+            for (int i = 0; i < std::min(rows, 3); ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    t.at<float>(i, j) = m(i, j);
+                }
+                t.at<float>(i, cn) = m(i, 3) * range;
+            }
+            if (rows == 4) {
+                t.at<float>(3, 3) = 1;
+            }
+
+            cv::transform(src, dst, t);
+        }
+
+        /**
+         * Consecutive affine ops multiplied into one
+         *
+         * Values are not clamped between the folded ops any more,
+         * which only makes the result more precise
+         */
+        std::vector<PointOp> fold(const std::vector<PointOp>& ops) {
+            std::vector<PointOp> res;
+            for (const auto& op : ops) {
+                if (!res.empty() && res.back().kind == PointOp::Kind::Affine && op.kind == PointOp::Kind::Affine) {
+                    res.back() = res.back().then(op);
+                } else {
+                    res.push_back(op);
+                }
+            }
+            return res;
+        }
+    }
+
+
+    void apply_point_op(const PointOp& op, cv::Mat& colors) {
+        CV_Assert(colors.type() == CV_32FC3);
+
+        cv::Mat planes[3];
+        cv::split(colors * 255, planes);
+
+        for (int y = 0; y < colors.rows; ++y) {
+            apply(op, planes[0].ptr<float>(y), planes[1].ptr<float>(y), planes[2].ptr<float>(y), colors.cols);
+        }
+
+        cv::merge(planes, 3, colors);
+        colors /= 255;
+    }
+
+
+    FusedPointOps::FusedPointOps(std::vector<std::shared_ptr<const Command>> commands, bool linear_light)
+            : commands{std::move(commands)}, linear_light{linear_light} {
+        std::vector<PointOp> all;
+        for (const auto& command : this->commands) {
+            PointOp op;
+            CV_Assert(command->point_op(op));
+            all.push_back(op);
+        }
+        ops = fold(all);
+    }
+
+    bool has_point_kernel(int type) {
+        const int depth = CV_MAT_DEPTH(type), cn = CV_MAT_CN(type);
+        return (depth == CV_8U || depth == CV_16U) && (cn == 1 || cn == 3 || cn == 4);
+    }
+
+    void apply_point_ops(const std::vector<PointOp>& ops, const cv::Mat& src, cv::Mat& dst, bool linear_light) {
+        CV_Assert(has_point_kernel(src.type()));
+
+        // keeps the pixels if dst is src and gets another type
+        const cv::Mat source = src;
+
+        // gray that gets color is expanded first and changed in place
+        if (source.channels() == 1 &&
+            !std::all_of(ops.begin(), ops.end(), [](const PointOp& op) { return op.keeps_gray(); })) {
+            if (dst.data && dst.datastart == source.datastart) {
+                dst = cv::Mat();
+            }
+            cv::cvtColor(source, dst, cv::COLOR_GRAY2BGR);
+            apply_point_ops(ops, dst, dst, linear_light);
+            return;
+        }
+
+        // nothing but gray is left, one channel holds it
+        const bool gray_out = source.channels() == 3 && !ops.empty() && ops.back().makes_gray();
+
+        if (ops.size() == 1 && ops[0].kind == PointOp::Kind::Affine && !linear_light) {
+            transform_affine(ops[0].matrix, source, dst, gray_out);
+            return;
+        }
+
+        dst.create(source.size(), CV_MAKETYPE(source.depth(), gray_out ? 1 : source.channels()));
+
+        if (source.depth() == CV_8U) {
+            run_fused<uchar>(ops, source, dst, gray_out, linear_light);
+        } else {
+            run_fused<ushort>(ops, source, dst, gray_out, linear_light);
+        }
+    }
+
+
+    cv::Mat FusedPointOps::execute(const cv::Mat& image) const {
+        cv::Mat res;
+        execute_into(image, res);
+        return res;
+    }
+
+    void FusedPointOps::execute_into(const cv::Mat& image, cv::Mat& dst) const {
+        if (!has_point_kernel(image.type())) {
+            cv::Mat res = image;
+            for (const auto& command : commands) {
+                res = command->execute(res);
+            }
+            dst = res;
+            return;
+        }
+
+        apply_point_ops(ops, image, dst, linear_light);
+    }
+
+    bool FusedPointOps::in_place() const {
+        return true;
+    }
+
+
+    bool FusedPointOps::is_color_op() const {
+        return true;
+    }
+
+    void FusedPointOps::apply_to_colors(cv::Mat& colors) const {
+        for (const auto& op : ops) {
+            apply_point_op(op, colors);
+        }
+    }
+
+
+    Pipeline::Pipeline(const std::vector<std::shared_ptr<const Command>>& commands, bool linear_light) {
+        std::vector<std::shared_ptr<const Command>> run;
+        bool point_ops_only = true;
+        std::vector<std::shared_ptr<const Command>> warps;
+
+        auto flush_warps = [&]() {
+            if (!warps.empty()) {
+                stages.push_back(std::make_shared<Warp>(std::move(warps)));
+                warps.clear();
+            }
+        };
+
+        auto flush = [&]() {
+            if (run.empty()) {
+                return;
+            }
+
+            if (point_ops_only) {
+                stages.push_back(std::make_shared<FusedPointOps>(std::move(run), linear_light));
+            } else {
+                stages.push_back(std::make_shared<Lut3D>(run));
+            }
+
+            run.clear();
+            point_ops_only = true;
+        };
+
+        for (const auto& command : commands) {
+            PointOp op;
+            if (command->is_color_op()) {
+                flush_warps();
+                point_ops_only &= command->point_op(op);
+                run.push_back(command);
+            } else if (command->is_warp()) {
+                flush();
+                warps.push_back(command);
+            } else {
+                flush();
+                flush_warps();
+                stages.push_back(command);
+            }
+        }
+
+        flush();
+        flush_warps();
+    }
+
+    cv::Mat Pipeline::execute(const cv::Mat& image) const {
+        cv::Mat res;
+        TileScheduler().run(stages, image, res);
+        return res;
+    }
+
+    void Pipeline::execute_into(const cv::Mat& image, cv::Mat& dst) const {
+        TileScheduler().run(stages, image, dst);
+    }
+
+    bool Pipeline::is_tileable() const {
+        return std::all_of(stages.begin(), stages.end(),
+                           [](const auto& stage) { return stage->is_tileable(); });
+    }
+
+    int Pipeline::halo() const {
+        int halo = 0;
+        for (const auto& stage : stages) {
+            halo += stage->halo();
+        }
+        return halo;
+    }
+
+    size_t Pipeline::size() const {
+        return stages.size();
+    }
+}
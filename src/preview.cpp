@@ -0,0 +1,43 @@
+#include "../include/preview.h"
+
+namespace image_algorithms {
+
+    void PreviewPyramid::reset(const cv::Mat& image) {
+        levels.clear();
+        levels.push_back(image);
+    }
+
+    Proxy PreviewPyramid::level(const cv::Size& size) {
+        if (levels.empty() || levels.front().empty()) {
+            return {};
+        }
+
+        size_t i = 0;
+        while (true) {
+            cv::Size half((levels[i].cols + 1) / 2, (levels[i].rows + 1) / 2);
+
+            // next level would be smaller than asked for
+            if (half.width < size.width || half.height < size.height || half.width < 2 || half.height < 2) {
+                break;
+            }
+
+            if (i + 1 == levels.size()) {
+                cv::Mat next;
+                cv::resize(levels[i], next, half, 0, 0, cv::INTER_AREA);
+                levels.push_back(next);
+            }
+            ++i;
+        }
+
+        return {levels[i], (double) levels[i].cols / levels.front().cols};
+    }
+
+    Proxy PreviewPyramid::level(double scale) {
+        if (levels.empty()) {
+            return {};
+        }
+
+        const cv::Mat& full = levels.front();
+        return level(cv::Size(cvFloor(full.cols * scale), cvFloor(full.rows * scale)));
+    }
+}
@@ -0,0 +1,145 @@
+#include "../include/recipe.h"
+
+#include <map>
+#include <mutex>
+
+namespace image_algorithms {
+
+    namespace {
+
+        // bumped when fields of a command change their meaning
+        const int recipe_version = 1;
+
+        struct Registry {
+            std::mutex mutex;
+            std::map<std::string, CommandReader> readers = {
+                    {"nothing",     &Nothing::read},
+                    {"crop",        &Crop::read},
+                    {"rotate",      &RotateInFrame::read},
+                    {"saturate",    &Saturate::read},
+                    {"brighten",    &Brighten::read},
+                    {"lighten",     &Lighten::read},
+                    {"hue",         &Hue::read},
+                    {"contrast",    &Contrast::read},
+                    {"gray",        &Gray::read},
+                    {"blend",       &Blend::read},
+                    {"tint",        &Tint::read},
+                    {"temperature", &Temperature::read},
+                    {"blur",        &Blur::read},
+                    {"sharpen",     &Sharpen::read},
+                    {"color",       &ApplyColor::read},
+                    {"perspective", &TransformPerspective::read},
+            };
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        void write_recipe(cv::FileStorage& fs, const Recipe& recipe) {
+            fs << "version" << recipe_version;
+            fs << "commands" << "[";
+            for (const auto& command : recipe) {
+                write_command(fs, *command);
+            }
+            fs << "]";
+        }
+
+        Recipe read_recipe(const cv::FileStorage& fs) {
+            int version = (int) fs["version"];
+            if (version < 1 || version > recipe_version) {
+                CV_Error(cv::Error::StsBadArg, "unsupported recipe version " + std::to_string(version));
+            }
+
+            cv::FileNode commands = fs["commands"];
+            if (!commands.isSeq()) {
+                CV_Error(cv::Error::StsParseError, "recipe has no commands");
+            }
+
+            Recipe recipe;
+            for (const auto& node : commands) {
+                recipe.push_back(read_command(node));
+            }
+            return recipe;
+        }
+    }
+
+
+    void register_command(const std::string& name, CommandReader reader) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.readers[name] = reader;
+    }
+
+    void write_command(cv::FileStorage& fs, const Command& command) {
+        std::string name = command.name();
+        if (name.empty()) {
+            CV_Error(cv::Error::StsNotImplemented, "command can not be written to a recipe");
+        }
+
+        fs << "{" << "name" << name;
+        command.write(fs);
+        fs << "}";
+    }
+
+    std::shared_ptr<const Command> read_command(const cv::FileNode& node) {
+        std::string name = (std::string) node["name"];
+
+        CommandReader reader = nullptr;
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            auto it = r.readers.find(name);
+            if (it != r.readers.end()) {
+                reader = it->second;
+            }
+        }
+
+        if (!reader) {
+            CV_Error(cv::Error::StsBadArg, "unknown command '" + name + "'");
+        }
+        return reader(node);
+    }
+
+    bool write_recipe(const std::string& path, const Recipe& recipe) {
+        cv::FileStorage fs(path, cv::FileStorage::WRITE | cv::FileStorage::BASE64);
+        if (!fs.isOpened()) {
+            return false;
+        }
+
+        write_recipe(fs, recipe);
+        fs.release();
+        return true;
+    }
+
+    Recipe read_recipe(const std::string& path) {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            CV_Error(cv::Error::StsError, "can not open recipe " + path);
+        }
+        return read_recipe(fs);
+    }
+
+    std::string recipe_to_string(const Recipe& recipe, int format) {
+        cv::FileStorage fs(std::string(), cv::FileStorage::WRITE | cv::FileStorage::MEMORY |
+                                          cv::FileStorage::BASE64 | format);
+        write_recipe(fs, recipe);
+        return fs.releaseAndGetString();
+    }
+
+    Recipe recipe_from_string(const std::string& text) {
+        cv::FileStorage fs(text, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+        return read_recipe(fs);
+    }
+
+    Recipe scaled(const Recipe& recipe, double scale) {
+        Recipe res;
+        res.reserve(recipe.size());
+        for (const auto& command : recipe) {
+            auto command_scaled = command->scaled(scale);
+            res.push_back(command_scaled ? command_scaled : command);
+        }
+        return res;
+    }
+}
@@ -0,0 +1,64 @@
+#include "renderworker.h"
+
+RenderWorker::RenderWorker(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<cv::Mat>("cv::Mat");
+    thread = std::thread(&RenderWorker::work, this);
+}
+
+RenderWorker::~RenderWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        ++latest;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+quint64 RenderWorker::post(Job job) {
+    quint64 generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = std::move(job);
+        generation = ++latest;
+    }
+    wake.notify_one();
+    return generation;
+}
+
+void RenderWorker::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = nullptr;
+    ++latest;
+}
+
+quint64 RenderWorker::generation() const {
+    return latest;
+}
+
+void RenderWorker::work() {
+    while (true) {
+        Job job;
+        quint64 generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || pending; });
+            if (stopping) {
+                return;
+            }
+            job = std::move(pending);
+            pending = nullptr;
+            generation = latest;
+        }
+
+        // a newer job makes this one stale
+        cv::Mat image = job([this, generation]() { return latest != generation; });
+
+        // stale results are passed on too, their buffers may have to be given back
+        if (!image.empty()) {
+            emit rendered(image, generation);
+        } else if (latest == generation) {
+            emit failed(generation);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#include "../include/resultcache.h"
+#include "../include/tilestore.h"
+
+namespace image_algorithms {
+
+    namespace {
+
+        size_t byte_size(const cv::Mat& image) {
+            return image.total() * image.elemSize();
+        }
+    }
+
+
+    ResultCache::ResultCache(size_t budget) : max_bytes{budget} {
+    }
+
+    std::string ResultCache::key(const Command& command, const cv::Mat& input) {
+        std::string command_key = command.key();
+        if (command_key.empty() || input.empty()) {
+            return "";
+        }
+        return std::to_string(hash_image(input)) + " " + command_key;
+    }
+
+    bool ResultCache::find(const std::string& key, cv::Mat& result, double& seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++counters.misses;
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        result = it->second->result;
+        seconds = it->second->seconds;
+        ++counters.hits;
+        return true;
+    }
+
+    void ResultCache::insert(const std::string& key, const cv::Mat& result, double seconds) {
+        const size_t bytes = byte_size(result);
+        if (key.empty() || bytes > max_bytes) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // two threads rendered the same thing
+        if (index.count(key)) {
+            return;
+        }
+
+        entries.push_front({key, result, seconds});
+        index.emplace(key, entries.begin());
+        counters.bytes += bytes;
+
+        while (counters.bytes > max_bytes) {
+            counters.bytes -= byte_size(entries.back().result);
+            index.erase(entries.back().key);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+    }
+
+    void ResultCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+        counters.bytes = 0;
+    }
+
+    ResultCache::Stats ResultCache::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats res = counters;
+        res.entries = entries.size();
+        return res;
+    }
+
+    size_t ResultCache::budget() const {
+        return max_bytes;
+    }
+}
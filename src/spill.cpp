@@ -0,0 +1,152 @@
+#include "../include/spill.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace image_algorithms {
+
+    namespace {
+
+        bool write_all(int fd, const uchar* data, size_t length, size_t offset) {
+            while (length > 0) {
+                ssize_t written = pwrite(fd, data, length, (off_t) offset);
+                if (written <= 0) {
+                    return false;
+                }
+                data += written;
+                length -= written;
+                offset += written;
+            }
+            return true;
+        }
+    }
+
+
+    SpillFile::State::~State() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    SpillFile::SpillFile() : state{std::make_shared<State>()} {
+        std::string dir = directory();
+
+        // cache directory itself may be missing too
+        mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0700);
+        mkdir(dir.c_str(), 0700);
+
+        std::string path = dir + "/history-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+
+        state->fd = mkstemp(name.data());
+        if (state->fd >= 0) {
+            unlink(name.data());
+        }
+    }
+
+    std::string SpillFile::directory() {
+        const char* cache = std::getenv("XDG_CACHE_HOME");
+        if (cache && *cache) {
+            return std::string(cache) + "/photoeditor";
+        }
+
+        const char* home = std::getenv("HOME");
+        return std::string(home ? home : "/tmp") + "/.cache/photoeditor";
+    }
+
+    bool SpillFile::is_open() const {
+        return state->fd >= 0;
+    }
+
+    std::shared_ptr<const SpilledImage> SpillFile::write(const cv::Mat& image) {
+        if (!is_open() || image.empty()) {
+            return nullptr;
+        }
+
+        // extents start at page boundaries, so they can be mapped
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t row_bytes = image.cols * image.elemSize();
+        const size_t length = (row_bytes * image.rows + page - 1) / page * page;
+
+        size_t offset;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+
+            auto it = state->free.lower_bound(length);
+            if (it != state->free.end()) {
+                offset = it->second;
+                if (it->first > length) {
+                    state->free.emplace(it->first - length, offset + length);
+                }
+                state->free.erase(it);
+            } else {
+                offset = state->end;
+                if (ftruncate(state->fd, (off_t) (offset + length)) != 0) {
+                    return nullptr;
+                }
+                state->end += length;
+            }
+
+            state->bytes += length;
+        }
+
+        // releases the extent if writing fails
+        std::shared_ptr<const SpilledImage> res(
+                new SpilledImage(state, offset, length, image.size(), image.type()));
+
+        if (image.isContinuous()) {
+            if (!write_all(state->fd, image.data, row_bytes * image.rows, offset)) {
+                return nullptr;
+            }
+        } else {
+            for (int y = 0; y < image.rows; ++y) {
+                if (!write_all(state->fd, image.ptr<uchar>(y), row_bytes, offset + y * row_bytes)) {
+                    return nullptr;
+                }
+            }
+        }
+
+        return res;
+    }
+
+    size_t SpillFile::bytes() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->bytes;
+    }
+
+
+    SpilledImage::SpilledImage(std::shared_ptr<SpillFile::State> file, size_t offset, size_t length,
+                               cv::Size size, int type)
+            : file{std::move(file)}, offset{offset}, length{length}, size{size}, type{type} {
+    }
+
+    SpilledImage::~SpilledImage() {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        file->free.emplace(length, offset);
+        file->bytes -= length;
+    }
+
+    cv::Mat SpilledImage::read() const {
+        void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file->fd, (off_t) offset);
+        if (map == MAP_FAILED) {
+            return cv::Mat();
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+
+        cv::Mat res(size, type);
+        std::memcpy(res.data, map, res.total() * res.elemSize());
+
+        munmap(map, length);
+        return res;
+    }
+
+    size_t SpilledImage::bytes() const {
+        return length;
+    }
+}
@@ -0,0 +1,145 @@
+#include "../include/threadpool.h"
+
+#include <exception>
+
+namespace image_algorithms {
+
+    ThreadPool::ThreadPool(unsigned threads) {
+        threads = std::max(threads, 1u);
+
+        for (unsigned i = 0; i < threads; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    bool ThreadPool::pop(size_t self, Task& task) {
+        // own queue first, newest task is the most likely to be in cache
+        {
+            Queue& own = *queues[self % queues.size()];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                --pending;
+                return true;
+            }
+        }
+
+        // steal the oldest task of somebody else
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& other = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.tasks.empty()) {
+                task = std::move(other.tasks.front());
+                other.tasks.pop_front();
+                --pending;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void ThreadPool::work(size_t self) {
+        while (true) {
+            Task task;
+            if (pop(self, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this]() { return stopping || pending > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) {
+            return;
+        }
+
+        struct Batch {
+            std::atomic<size_t> remaining;
+            std::mutex mutex;
+            std::condition_variable done;
+            // first exception thrown by a task
+            std::exception_ptr error;
+        };
+
+        auto batch = std::make_shared<Batch>();
+        batch->remaining = count;
+
+        // deal tasks round-robin, idle workers will steal the rest
+        for (size_t i = 0; i < count; ++i) {
+            Queue& queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.emplace_back([batch, &task, i]() {
+                // thrown on a worker it would terminate, the caller rethrows it
+                try {
+                    task(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    if (!batch->error) {
+                        batch->error = std::current_exception();
+                    }
+                }
+
+                if (--batch->remaining == 0) {
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    batch->done.notify_all();
+                }
+            });
+            ++pending;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_all();
+
+        // help instead of blocking, this also keeps nested calls from deadlocking
+        while (batch->remaining > 0) {
+            Task other;
+            if (pop(0, other)) {
+                other();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->done.wait(lock, [&batch]() { return batch->remaining == 0; });
+        }
+
+        // only now, no task refers to the caller's frame anymore
+        if (batch->error) {
+            std::rethrow_exception(batch->error);
+        }
+    }
+
+    size_t ThreadPool::size() const {
+        return workers.size();
+    }
+
+    ThreadPool& ThreadPool::instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+}
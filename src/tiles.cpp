@@ -0,0 +1,185 @@
+#include "../include/tiles.h"
+
+#include <unistd.h>
+
+namespace image_algorithms {
+
+    size_t l2_cache_size() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (size > 0) {
+            return size;
+        }
+#endif
+        return 1 << 20;
+    }
+
+
+    namespace {
+
+        /**
+         * Result of command on image, written over image if own is set
+         * and the command allows it
+         *
+         * own says whether nobody else reads image and is updated for
+         * the result: a new buffer is own, a view of image only if
+         * image was. Commands return new buffers or views of their input
+         */
+        cv::Mat run_step(const Command& command, const cv::Mat& image, bool& own) {
+            cv::Mat res;
+            if (own && command.in_place()) {
+                res = image;
+            }
+            command.execute_into(image, res);
+
+            if (res.datastart != image.datastart) {
+                own = true;
+            }
+            return res;
+        }
+
+        int chain_halo(const std::vector<const Command*>& chain) {
+            int halo = 0;
+            for (const auto* command : chain) {
+                halo += command->halo();
+            }
+            return halo;
+        }
+
+        // Every command after the first one sees its input as a separate image
+        // and borders it by itself, so wrong pixels creep inwards by its halo.
+        // Widening the tile by the sum of halos keeps them out of the inner part
+        cv::Mat run_tile(const std::vector<const Command*>& chain, const cv::Mat& src, const cv::Rect& tile,
+                         int halo) {
+            cv::Rect outer(tile.x - halo, tile.y - halo, tile.width + 2 * halo, tile.height + 2 * halo);
+            outer &= cv::Rect(0, 0, src.cols, src.rows);
+
+            // first command reads a view, so it also sees pixels around the tile
+            cv::Mat res = src(outer);
+            bool own = false;
+            for (const auto* command : chain) {
+                res = run_step(*command, res, own);
+            }
+
+            return res(tile - outer.tl());
+        }
+
+        bool run_chain(const std::vector<const Command*>& chain, const cv::Mat& src, cv::Mat& dst,
+                       ThreadPool& pool, int side, const Cancelled& cancelled = nullptr) {
+            if (src.empty()) {
+                dst.release();
+                return true;
+            }
+
+            // tiles read around themselves, so result can't overwrite the source
+            if (dst.datastart == src.datastart) {
+                dst = cv::Mat();
+            }
+
+            int halo = chain_halo(chain);
+            int nx = (src.cols + side - 1) / side;
+            int ny = (src.rows + side - 1) / side;
+
+            auto tile = [&](size_t i) {
+                cv::Rect rect((int) (i % nx) * side, (int) (i / nx) * side, side, side);
+                return rect & cv::Rect(0, 0, src.cols, src.rows);
+            };
+
+            std::atomic<bool> stop{false};
+            auto stopped = [&]() {
+                if (!stop && cancelled && cancelled()) {
+                    stop = true;
+                }
+                return stop.load();
+            };
+
+            if (stopped()) {
+                return false;
+            }
+
+            // first tile tells the type of result
+            cv::Mat first = run_tile(chain, src, tile(0), halo);
+            dst.create(src.size(), first.type());
+            first.copyTo(dst(tile(0)));
+
+            pool.parallel_for(nx * ny - 1, [&](size_t i) {
+                if (!stopped()) {
+                    run_tile(chain, src, tile(i + 1), halo).copyTo(dst(tile(i + 1)));
+                }
+            });
+
+            return !stopped();
+        }
+    }
+
+
+    TileScheduler::TileScheduler(size_t cache_bytes, ThreadPool& pool) : cache_bytes{cache_bytes}, pool{pool} {
+    }
+
+    int TileScheduler::tile_side(const cv::Mat& image, int halo) const {
+        // source, result and an intermediate buffer per tile
+        double pixels = (double) cache_bytes / (3 * std::max<size_t>(image.elemSize(), 1));
+        int side = (int) std::sqrt(pixels) - 2 * halo;
+
+        // halo shouldn't take most of the work
+        return std::max({side, 2 * halo, 64});
+    }
+
+    bool TileScheduler::run(const std::vector<std::shared_ptr<const Command>>& chain, const cv::Mat& src,
+                            cv::Mat& dst, const Cancelled& cancelled) const {
+        cv::Mat current = src;
+        // src belongs to the caller, intermediate results to this run
+        bool own = false;
+        cv::Mat tmp;
+        size_t i = 0;
+
+        while (i < chain.size()) {
+            if (cancelled && cancelled()) {
+                return false;
+            }
+
+            if (!chain[i]->is_tileable()) {
+                const Command& command = *chain[i++];
+
+                if (i == chain.size()) {
+                    if (!command.in_place() && dst.data && dst.datastart == current.datastart) {
+                        dst = cv::Mat();
+                    }
+                    command.execute_into(current, dst);
+                    return true;
+                }
+
+                // intermediate results nobody else sees are overwritten
+                current = run_step(command, current, own);
+                continue;
+            }
+
+            std::vector<const Command*> segment;
+            while (i < chain.size() && chain[i]->is_tileable()) {
+                segment.push_back(chain[i++].get());
+            }
+
+            // last segment renders straight into dst
+            cv::Mat& out = i == chain.size() ? dst : tmp;
+            if (!run_chain(segment, current, out, pool, tile_side(current, chain_halo(segment)), cancelled)) {
+                return false;
+            }
+            current = out;
+            own = true;
+            tmp = cv::Mat();
+        }
+
+        dst = current;
+        return true;
+    }
+
+    cv::Mat TileScheduler::execute(const Command& command, const cv::Mat& image) const {
+        if (!command.is_tileable()) {
+            return command.execute(image);
+        }
+
+        cv::Mat res;
+        run_chain({&command}, image, res, pool, tile_side(image, command.halo()));
+        return res;
+    }
+}
@@ -0,0 +1,231 @@
+#include "../include/tilestore.h"
+#include "../include/threadpool.h"
+
+#include <cstring>
+
+namespace image_algorithms {
+
+    namespace {
+
+        inline uint64_t mix(uint64_t h, uint64_t w) {
+            h ^= w;
+            h *= 0x9e3779b97f4a7c15ull;
+            return h ^ (h >> 32);
+        }
+
+        bool same_pixels(const cv::Mat& a, const cv::Mat& b) {
+            if (a.size() != b.size() || a.type() != b.type()) {
+                return false;
+            }
+
+            const size_t row_bytes = a.cols * a.elemSize();
+            for (int y = 0; y < a.rows; ++y) {
+                if (std::memcmp(a.ptr<uchar>(y), b.ptr<uchar>(y), row_bytes) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t byte_size(const cv::Mat& pixels) {
+            return pixels.total() * pixels.elemSize();
+        }
+    }
+
+
+    // four independent lanes keep the multiplier busy,
+    // hashing is then about as fast as copying
+    uint64_t hash_pixels(const cv::Mat& pixels) {
+        uint64_t lanes[4] = {
+                (uint64_t) pixels.rows << 32 | (uint32_t) pixels.cols,
+                (uint64_t) pixels.type(),
+                0x243f6a8885a308d3ull,
+                0x13198a2e03707344ull
+        };
+
+        const size_t row_bytes = pixels.cols * pixels.elemSize();
+
+        for (int y = 0; y < pixels.rows; ++y) {
+            const uchar* p = pixels.ptr<uchar>(y);
+            size_t i = 0;
+
+            for (; i + 32 <= row_bytes; i += 32) {
+                uint64_t w[4];
+                std::memcpy(w, p + i, 32);
+                for (int k = 0; k < 4; ++k) {
+                    lanes[k] = mix(lanes[k], w[k]);
+                }
+            }
+
+            for (; i < row_bytes; ++i) {
+                lanes[i & 3] = mix(lanes[i & 3], p[i]);
+            }
+        }
+
+        return mix(mix(mix(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+    }
+
+    uint64_t hash_image(const cv::Mat& image) {
+        const int bands = (image.rows + TiledImage::tile_side - 1) / TiledImage::tile_side;
+        std::vector<uint64_t> hashes(bands);
+
+        ThreadPool::instance().parallel_for(hashes.size(), [&](size_t i) {
+            int y = (int) i * TiledImage::tile_side;
+            hashes[i] = hash_pixels(image.rowRange(y, std::min(y + TiledImage::tile_side, image.rows)));
+        });
+
+        uint64_t res = mix((uint64_t) image.rows << 32 | (uint32_t) image.cols, (uint64_t) image.type());
+        for (uint64_t hash : hashes) {
+            res = mix(res, hash);
+        }
+        return res;
+    }
+
+
+    TileStore::TileStore() : state{std::make_shared<State>()} {
+    }
+
+    TileStore::TilePtr TileStore::intern(const cv::Mat& pixels) {
+        const uint64_t hash = hash_pixels(pixels);
+
+        auto find = [&]() -> TilePtr {
+            auto range = state->tiles.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                TilePtr tile = it->second.lock();
+                if (tile && same_pixels(tile->pixels, pixels)) {
+                    return tile;
+                }
+            }
+            return nullptr;
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (TilePtr tile = find()) {
+                return tile;
+            }
+        }
+
+        // copy outside of the lock, other threads keep interning
+        auto* tile = new Tile{hash, pixels.clone()};
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        // somebody else could have stored the same tile meanwhile
+        if (TilePtr existing = find()) {
+            delete tile;
+            return existing;
+        }
+
+        std::shared_ptr<State> owner = state;
+        TilePtr res(tile, [owner](const Tile* tile) {
+            {
+                std::lock_guard<std::mutex> lock(owner->mutex);
+                owner->bytes -= byte_size(tile->pixels);
+
+                auto range = owner->tiles.equal_range(tile->hash);
+                for (auto it = range.first; it != range.second;) {
+                    it = it->second.expired() ? owner->tiles.erase(it) : std::next(it);
+                }
+            }
+            delete tile;
+        });
+
+        state->tiles.emplace(hash, res);
+        state->bytes += byte_size(tile->pixels);
+        return res;
+    }
+
+    size_t TileStore::bytes() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->bytes;
+    }
+
+    size_t TileStore::size() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->tiles.size();
+    }
+
+
+    TiledImage::TiledImage(const cv::Mat& image, TileStore& store) : image_size{image.size()}, image_type{image.type()} {
+        // a view keeps the grid of the image it is part of, so crops share tiles with it
+        cv::Size whole;
+        cv::Point offset;
+        image.locateROI(whole, offset);
+        grid_origin = cv::Point(offset.x % tile_side, offset.y % tile_side);
+
+        tiles_grid = cv::Size((grid_origin.x + image.cols + tile_side - 1) / tile_side,
+                              (grid_origin.y + image.rows + tile_side - 1) / tile_side);
+        tiles.resize(tiles_grid.area());
+
+        ThreadPool::instance().parallel_for(tiles.size(), [&](size_t i) {
+            int row = (int) i / tiles_grid.width;
+            int col = (int) i % tiles_grid.width;
+            tiles[i] = store.intern(image(tile_rect(row, col)));
+        });
+    }
+
+    bool TiledImage::empty() const {
+        return tiles.empty();
+    }
+
+    cv::Size TiledImage::size() const {
+        return image_size;
+    }
+
+    int TiledImage::type() const {
+        return image_type;
+    }
+
+    cv::Size TiledImage::grid() const {
+        return tiles_grid;
+    }
+
+    cv::Point TiledImage::origin() const {
+        return grid_origin;
+    }
+
+    cv::Rect TiledImage::tile_rect(int row, int col) const {
+        cv::Rect rect(col * tile_side - grid_origin.x, row * tile_side - grid_origin.y, tile_side, tile_side);
+        return rect & cv::Rect(cv::Point(), image_size);
+    }
+
+    cv::Mat TiledImage::tile(int row, int col) const {
+        return tiles[row * tiles_grid.width + col]->pixels;
+    }
+
+    cv::Mat TiledImage::region(const cv::Rect& rect) const {
+        CV_Assert((rect & cv::Rect(cv::Point(), image_size)) == rect);
+
+        int row = (rect.y + grid_origin.y) / tile_side;
+        int col = (rect.x + grid_origin.x) / tile_side;
+        cv::Rect first = tile_rect(row, col);
+
+        if ((first & rect) == rect) {
+            return tile(row, col)(rect - first.tl());
+        }
+
+        cv::Mat res(rect.size(), image_type);
+        for (int r = row; r * tile_side - grid_origin.y < rect.y + rect.height; ++r) {
+            for (int c = col; c * tile_side - grid_origin.x < rect.x + rect.width; ++c) {
+                cv::Rect part = tile_rect(r, c) & rect;
+                tile(r, c)(part - tile_rect(r, c).tl()).copyTo(res(part - rect.tl()));
+            }
+        }
+        return res;
+    }
+
+    cv::Mat TiledImage::mat() const {
+        // placed in its buffer as in the grid, so crops of it keep sharing tiles
+        cv::Mat buffer(image_size.height + grid_origin.y, image_size.width + grid_origin.x, image_type);
+        cv::Mat res = buffer(cv::Rect(grid_origin, image_size));
+
+        ThreadPool::instance().parallel_for(tiles.size(), [&](size_t i) {
+            int row = (int) i / tiles_grid.width;
+            int col = (int) i % tiles_grid.width;
+            tile(row, col).copyTo(res(tile_rect(row, col)));
+        });
+
+        return res;
+    }
+}
@@ -0,0 +1,173 @@
+#include "../include/unsharp.h"
+#include "../include/algorithms.h"
+
+#include <vector>
+
+namespace image_algorithms {
+
+    namespace {
+
+        // rows of a stripe, its source rows are converted once per stripe
+        const int stripe_rows = 32;
+
+        template<typename T>
+        class UnsharpBody : public cv::ParallelLoopBody {
+        private:
+            const cv::Mat& src;
+            cv::Mat& dst;
+            std::vector<float> kernel;
+            int radius;
+            float amount;
+            float threshold;
+            bool luminance;
+
+        public:
+            UnsharpBody(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, float amount, float threshold,
+                        bool luminance)
+                    : src{src}, dst{dst}, kernel(kernel.begin<float>(), kernel.end<float>()),
+                      radius{kernel.rows / 2}, amount{amount}, threshold{threshold}, luminance{luminance} {}
+
+            void operator()(const cv::Range& range) const override {
+                const int cols = src.cols;
+                const int cn = src.channels();
+                // channels that are blurred
+                const int bn = luminance ? 1 : cn;
+                const int width = cols * bn;
+
+                const int y0 = range.start * stripe_rows;
+                const int y1 = std::min(range.end * stripe_rows, src.rows);
+                const int ksize = (int) kernel.size();
+
+                // source rows of the stripe and around it as floats
+                std::vector<float> rows((y1 - y0 + 2 * radius) * width);
+                for (int i = 0; i < y1 - y0 + 2 * radius; ++i) {
+                    int y = cv::borderInterpolate(y0 - radius + i, src.rows, cv::BORDER_REFLECT_101);
+                    load_row(src.ptr<T>(y), &rows[i * width], cols, cn);
+                }
+
+                // vertically blurred row, padded by radius pixels on both sides
+                std::vector<float> padded((cols + 2 * radius) * bn);
+                std::vector<float> blurred(width);
+
+                for (int y = y0; y < y1; ++y) {
+                    float* v = &padded[radius * bn];
+                    std::fill(v, v + width, 0.f);
+                    for (int k = 0; k < ksize; ++k) {
+                        const float* r = &rows[(y - y0 + k) * width];
+                        const float w = kernel[k];
+                        for (int i = 0; i < width; ++i) {
+                            v[i] += w * r[i];
+                        }
+                    }
+
+                    for (int x = 1; x <= radius; ++x) {
+                        int left = cv::borderInterpolate(-x, cols, cv::BORDER_REFLECT_101);
+                        int right = cv::borderInterpolate(cols - 1 + x, cols, cv::BORDER_REFLECT_101);
+                        for (int c = 0; c < bn; ++c) {
+                            v[-x * bn + c] = v[left * bn + c];
+                            v[(cols - 1 + x) * bn + c] = v[right * bn + c];
+                        }
+                    }
+
+                    std::fill(blurred.begin(), blurred.end(), 0.f);
+                    for (int k = 0; k < ksize; ++k) {
+                        const float* h = &padded[k * bn];
+                        const float w = kernel[k];
+                        for (int i = 0; i < width; ++i) {
+                            blurred[i] += w * h[i];
+                        }
+                    }
+
+                    combine(src.ptr<T>(y), &rows[(y - y0 + radius) * width], blurred.data(), dst.ptr<T>(y),
+                            cols, cn);
+                }
+            }
+
+        private:
+            void load_row(const T* s, float* r, int cols, int cn) const {
+                if (!luminance) {
+                    for (int i = 0; i < cols * cn; ++i) {
+                        r[i] = s[i];
+                    }
+                } else if (cn >= 3) {
+                    for (int x = 0; x < cols; ++x) {
+                        const T* p = s + x * cn;
+                        r[x] = 0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2];
+                    }
+                } else {
+                    for (int x = 0; x < cols; ++x) {
+                        r[x] = s[x * cn];
+                    }
+                }
+            }
+
+            // original is the blurred channel before blurring
+            void combine(const T* s, const float* original, const float* blurred, T* d, int cols, int cn) const {
+                if (!luminance) {
+                    for (int i = 0; i < cols * cn; ++i) {
+                        float detail = original[i] - blurred[i];
+                        float gain = std::abs(detail) > threshold ? amount : 0.f;
+                        d[i] = cv::saturate_cast<T>(s[i] + gain * detail);
+                    }
+                    return;
+                }
+
+                for (int x = 0; x < cols; ++x) {
+                    float detail = original[x] - blurred[x];
+                    float shift = std::abs(detail) > threshold ? amount * detail : 0.f;
+                    for (int c = 0; c < cn; ++c) {
+                        // alpha is not sharpened
+                        d[x * cn + c] = c < 3 ? cv::saturate_cast<T>(s[x * cn + c] + shift) : s[x * cn + c];
+                    }
+                }
+            }
+        };
+
+        template<typename T>
+        void run(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernel, double amount, double threshold,
+                 bool luminance) {
+            const int stripes = (src.rows + stripe_rows - 1) / stripe_rows;
+            cv::parallel_for_(cv::Range(0, stripes),
+                              UnsharpBody<T>(src, dst, kernel, (float) amount, (float) threshold, luminance));
+        }
+    }
+
+
+    cv::Mat unsharp_mask(const cv::Mat& image, double amount, double sigma, double threshold, bool luminance) {
+        if (image.empty()) {
+            return cv::Mat();
+        }
+
+        // same kernel size as GaussianBlur picks for 8-bit images
+        int ksize = sigma > 0 ? cvRound(sigma * 3 * 2 + 1) | 1 : 1;
+        // wider than the image the reflection would run out of pixels
+        ksize = std::min(ksize, (std::min(image.rows, image.cols) - 1) * 2 + 1);
+        cv::Mat kernel = cv::getGaussianKernel(ksize, std::max(sigma, 0.1), CV_32F);
+
+        cv::Mat res(image.size(), image.type());
+
+        // threshold is given for 8-bit values
+        const double levels = threshold * value_range(image.depth()) / 255;
+
+        switch (image.depth()) {
+            case CV_8U:
+                run<uchar>(image, res, kernel, amount, levels, luminance);
+                break;
+            case CV_16U:
+                run<ushort>(image, res, kernel, amount, levels, luminance);
+                break;
+            case CV_32F:
+                run<float>(image, res, kernel, amount, levels, luminance);
+                break;
+            default: {
+                // values keep the range of the depth, so does levels
+                cv::Mat converted, sharpened(image.size(), CV_MAKETYPE(CV_32F, image.channels()));
+                image.convertTo(converted, CV_32F);
+                run<float>(converted, sharpened, kernel, amount, levels, luminance);
+                sharpened.convertTo(res, image.depth());
+            }
+        }
+
+        return res;
+    }
+}
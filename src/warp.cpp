@@ -0,0 +1,172 @@
+#include "../include/warp.h"
+#include "../include/threadpool.h"
+
+#include <climits>
+#include <cmath>
+
+namespace image_algorithms {
+
+    namespace {
+
+        const int band_rows = 64;
+
+        bool near(double value, double target) {
+            return std::abs(value - target) < 1e-6;
+        }
+
+        bool is_integer(double value) {
+            return near(value, std::round(value));
+        }
+
+        /**
+         * True if transform moves whole pixels without resampling:
+         * a shift combined with quarter turns and flips
+         */
+        bool is_lossless(const cv::Matx33d& m) {
+            if (!near(m(2, 0), 0) || !near(m(2, 1), 0) || !near(m(2, 2), 1)) {
+                return false;
+            }
+
+            for (int i = 0; i < 2; ++i) {
+                for (int j = 0; j < 2; ++j) {
+                    if (!near(m(i, j), 0) && !near(std::abs(m(i, j)), 1)) {
+                        return false;
+                    }
+                }
+            }
+
+            bool straight = near(m(0, 1), 0) && near(m(1, 0), 0) && !near(m(0, 0), 0) && !near(m(1, 1), 0);
+            bool turned = near(m(0, 0), 0) && near(m(1, 1), 0) && !near(m(0, 1), 0) && !near(m(1, 0), 0);
+
+            return (straight || turned) && is_integer(m(0, 2)) && is_integer(m(1, 2));
+        }
+
+        // part of image the result of a lossless transform comes from
+        cv::Rect source_rect(const cv::Matx33d& m, cv::Size size) {
+            cv::Matx33d inverse = m.inv();
+            int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+
+            for (cv::Point corner : {cv::Point(0, 0), cv::Point(size.width - 1, 0),
+                                     cv::Point(0, size.height - 1), cv::Point(size.width - 1, size.height - 1)}) {
+                cv::Vec3d p = inverse * cv::Vec3d(corner.x, corner.y, 1);
+                int x = (int) std::lround(p[0]), y = (int) std::lround(p[1]);
+                x0 = std::min(x0, x);
+                y0 = std::min(y0, y);
+                x1 = std::max(x1, x);
+                y1 = std::max(y1, y);
+            }
+
+            return cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+        }
+
+        cv::Mat move_pixels(const cv::Mat& source, const cv::Matx33d& m) {
+            int a = (int) std::lround(m(0, 0)), b = (int) std::lround(m(0, 1));
+            int c = (int) std::lround(m(1, 0)), d = (int) std::lround(m(1, 1));
+
+            if (a == 1 && d == 1) {
+                return source;
+            }
+
+            cv::Mat res;
+            if (b == 0) {
+                // 1 mirrors x, 0 mirrors y, -1 both
+                cv::flip(source, res, a == -1 && d == -1 ? -1 : (a == -1 ? 1 : 0));
+            } else if (b == 1 && c == -1) {
+                cv::rotate(source, res, cv::ROTATE_90_COUNTERCLOCKWISE);
+            } else if (b == -1 && c == 1) {
+                cv::rotate(source, res, cv::ROTATE_90_CLOCKWISE);
+            } else {
+                cv::transpose(source, res);
+                if (b == -1) {
+                    cv::rotate(res, res, cv::ROTATE_180);
+                }
+            }
+            return res;
+        }
+    }
+
+
+    cv::Mat apply_warp(const cv::Mat& image, const cv::Matx33d& transform, cv::Size size) {
+        if (is_lossless(transform)) {
+            cv::Rect rect = source_rect(transform, size);
+            if ((rect & cv::Rect(cv::Point(), image.size())) == rect) {
+                return move_pixels(image(rect), transform);
+            }
+        }
+
+        const int bands = (size.height + band_rows - 1) / band_rows;
+        cv::Mat res(size, image.type());
+
+        const bool affine = transform(2, 0) == 0 && transform(2, 1) == 0 && transform(2, 2) == 1;
+
+        ThreadPool::instance().parallel_for(bands, [&](size_t i) {
+            int y = (int) i * band_rows;
+            cv::Mat band = res.rowRange(y, std::min(y + band_rows, size.height));
+
+            // same transform with the band at the origin
+            cv::Matx33d shifted = cv::Matx33d(1, 0, 0,
+                                              0, 1, -y,
+                                              0, 0, 1) * transform;
+            if (affine) {
+                cv::Matx23d rows(shifted(0, 0), shifted(0, 1), shifted(0, 2),
+                                 shifted(1, 0), shifted(1, 1), shifted(1, 2));
+                cv::warpAffine(image, band, rows, band.size());
+            } else {
+                cv::warpPerspective(image, band, shifted, band.size());
+            }
+        });
+
+        return res;
+    }
+
+
+    bool moves_pixels(const Command& command, cv::Size input) {
+        cv::Matx33d transform;
+        cv::Size output;
+        command.warp(input, transform, output);
+
+        cv::Rect rect = source_rect(transform, output);
+        return is_lossless(transform) && (rect & cv::Rect(cv::Point(), input)) == rect;
+    }
+
+
+    Warp::Warp(std::vector<std::shared_ptr<const Command>> commands) : commands{std::move(commands)} {
+        for (const auto& command : this->commands) {
+            CV_Assert(command->is_warp());
+        }
+    }
+
+    cv::Mat Warp::execute(const cv::Mat& image) const {
+        cv::Matx33d transform;
+        cv::Size size;
+        warp(image.size(), transform, size);
+        return apply_warp(image, transform, size);
+    }
+
+    bool Warp::is_warp() const {
+        return true;
+    }
+
+    void Warp::warp(cv::Size input, cv::Matx33d& transform, cv::Size& output) const {
+        transform = cv::Matx33d::eye();
+        output = input;
+
+        for (const auto& command : commands) {
+            cv::Matx33d step;
+            command->warp(output, step, output);
+            transform = step * transform;
+        }
+    }
+
+    std::string Warp::key() const {
+        std::string res = "warp";
+        for (const auto& command : commands) {
+            std::string command_key = command->key();
+            if (command_key.empty()) {
+                return "";
+            }
+            res += "\n" + command_key;
+        }
+        return res;
+    }
+}
@@ -0,0 +1,45 @@
+#include "../include/zoomanimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+ZoomAnimator::ZoomAnimator(QObject *parent) : QObject(parent) {
+    timer.setTimerType(Qt::PreciseTimer);
+    timer.setInterval(frameMs);
+    connect(&timer, &QTimer::timeout, this, &ZoomAnimator::step);
+}
+
+void ZoomAnimator::zoomBy(double factor, double scale) {
+    if (!timer.isActive()) {
+        current = target = scale;
+        timer.start();
+    }
+    start = current;
+    target = std::clamp(target * factor, minScale, maxScale);
+    clock.start();
+}
+
+void ZoomAnimator::stop() {
+    timer.stop();
+}
+
+bool ZoomAnimator::isActive() const {
+    return timer.isActive();
+}
+
+void ZoomAnimator::step() {
+    // frames come late under load, the scale follows the time that passed
+    const double t = std::min(1.0, (double) clock.elapsed() / durationMs);
+    const bool settled = t >= 1;
+
+    // cubic ease-out in log scale, so zooming in and out look the same
+    const double eased = 1 - std::pow(1 - t, 3);
+    current = start * std::pow(target / start, eased);
+
+    if (settled) {
+        current = target;
+        timer.stop();
+    }
+
+    emit zoomed(current, settled);
+}